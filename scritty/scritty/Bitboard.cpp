@@ -0,0 +1,203 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#include "Bitboard.h"
+
+using namespace scritty;
+
+/*static*/ Bitboard Bitboards::s_knight_attacks[64];
+/*static*/ Bitboard Bitboards::s_king_attacks[64];
+/*static*/ Bitboard Bitboards::s_pawn_attacks[2][64];
+/*static*/ Bitboard Bitboards::s_rays[DIRECTION_COUNT][64];
+/*static*/ Bitboard Bitboards::s_between[64][64];
+/*static*/ Bitboard Bitboards::s_line[64][64];
+
+/*static*/ Bitboards::Magic Bitboards::s_rook_magics[64];
+/*static*/ Bitboards::Magic Bitboards::s_bishop_magics[64];
+/*static*/ Bitboard Bitboards::s_rook_table[ROOK_TABLE_SIZE];
+/*static*/ Bitboard Bitboards::s_bishop_table[BISHOP_TABLE_SIZE];
+
+/*static*/ Bitboards Bitboards::s_instance;
+
+static void AddIfOnBoard(Bitboard *b, int file, int rank)
+{
+   if (file >= 0 && file <= 7 && rank >= 0 && rank <= 7)
+      *b |= SquareMask(SQUARE(file, rank));
+}
+
+#ifndef SCRITTY_USE_PEXT
+// xorshift generator with a fixed seed, so the magics found are the same on
+// every run
+static Bitboard NextRandom(Bitboard *state)
+{
+   *state ^= *state >> 12;
+   *state ^= *state << 25;
+   *state ^= *state >> 27;
+   return *state * 2685821657736338717ull;
+}
+
+// candidate magics with few bits set are much more likely to work
+static Bitboard NextSparseRandom(Bitboard *state)
+{
+   return NextRandom(state) & NextRandom(state) & NextRandom(state);
+}
+#endif
+
+/*static*/ void Bitboards::InitializeMagics(const Direction *directions,
+   Magic *magics, Bitboard *table)
+{
+   // every subset of the largest (rook) mask, and its attacks
+   Bitboard occupancies[4096];
+   Bitboard references[4096];
+
+#ifndef SCRITTY_USE_PEXT
+   unsigned int epochs[4096] = { 0 };
+   unsigned int epoch = 0;
+   Bitboard random_state = 1070372ull;
+#endif
+
+   for (unsigned char square = 0; square < 64; ++square)
+   {
+      Magic &magic = magics[square];
+
+      // blockers on the board edge never shorten a ray
+      const Bitboard edges =
+         ((RANK_1_MASK | RANK_8_MASK) & ~(RANK_1_MASK << 8*SQUARE_RANK(square)))
+         | ((FILE_A_MASK | FILE_H_MASK) & ~(FILE_A_MASK << SQUARE_FILE(square)));
+
+      Bitboard full = 0;
+      for (int i = 0; i < 4; ++i)
+         full |= s_rays[directions[i]][square];
+
+      magic.mask = full & ~edges;
+      magic.shift = 64 - CountSquares(magic.mask);
+      magic.attacks = table;
+
+      // enumerate the subsets of the mask (the carry-rippler trick)
+      unsigned int size = 0;
+      Bitboard occupied = 0;
+      do
+      {
+         occupancies[size] = occupied;
+         references[size] = 0;
+         for (int i = 0; i < 4; ++i)
+            references[size] |= RayAttacks(directions[i], square, occupied);
+
+#ifdef SCRITTY_USE_PEXT
+         table[magic.GetIndex(occupied)] = references[size];
+#endif
+
+         ++size;
+         occupied = (occupied - magic.mask) & magic.mask;
+      } while (occupied != 0);
+
+#ifndef SCRITTY_USE_PEXT
+      // try random multipliers until one maps every subset without a
+      // destructive collision
+      for (unsigned int i = 0; i < size; )
+      {
+         do
+         {
+            magic.multiplier = NextSparseRandom(&random_state);
+         } while (CountSquares((magic.mask*magic.multiplier) >> 56) < 6);
+
+         ++epoch;
+         for (i = 0; i < size; ++i)
+         {
+            unsigned int index = magic.GetIndex(occupancies[i]);
+
+            if (epochs[index] < epoch)
+            {
+               epochs[index] = epoch;
+               table[index] = references[i];
+            }
+            else if (table[index] != references[i])
+            {
+               break;
+            }
+         }
+      }
+#endif
+
+      table += size;
+   }
+}
+
+Bitboards::Bitboards()
+{
+   // file and rank steps for each direction, in Direction order
+   static const int file_steps[DIRECTION_COUNT] = { 0, 1, -1, 1, 0, -1, 1, -1 };
+   static const int rank_steps[DIRECTION_COUNT] = { 1, 1, 1, 0, -1, -1, -1, 0 };
+
+   static const int knight_files[8] = { 1, 2, 2, 1, -1, -2, -2, -1 };
+   static const int knight_ranks[8] = { 2, 1, -1, -2, -2, -1, 1, 2 };
+
+   for (int square = 0; square < 64; ++square)
+   {
+      const int file = SQUARE_FILE(square);
+      const int rank = SQUARE_RANK(square);
+
+      s_knight_attacks[square] = 0;
+      for (int i = 0; i < 8; ++i)
+         AddIfOnBoard(&s_knight_attacks[square],
+            file + knight_files[i], rank + knight_ranks[i]);
+
+      s_king_attacks[square] = 0;
+      for (int i = -1; i <= 1; ++i)
+         for (int j = -1; j <= 1; ++j)
+            if (i != 0 || j != 0)
+               AddIfOnBoard(&s_king_attacks[square], file + i, rank + j);
+
+      s_pawn_attacks[WHITE][square] = 0;
+      AddIfOnBoard(&s_pawn_attacks[WHITE][square], file - 1, rank + 1);
+      AddIfOnBoard(&s_pawn_attacks[WHITE][square], file + 1, rank + 1);
+
+      s_pawn_attacks[BLACK][square] = 0;
+      AddIfOnBoard(&s_pawn_attacks[BLACK][square], file - 1, rank - 1);
+      AddIfOnBoard(&s_pawn_attacks[BLACK][square], file + 1, rank - 1);
+
+      for (int direction = 0; direction < DIRECTION_COUNT; ++direction)
+      {
+         s_rays[direction][square] = 0;
+
+         int ray_file = file + file_steps[direction];
+         int ray_rank = rank + rank_steps[direction];
+
+         while (ray_file >= 0 && ray_file <= 7 && ray_rank >= 0 && ray_rank <= 7)
+         {
+            s_rays[direction][square] |= SquareMask(SQUARE(ray_file, ray_rank));
+            ray_file += file_steps[direction];
+            ray_rank += rank_steps[direction];
+         }
+      }
+   }
+
+   // every square along a ray is on a line with the start of the ray (the
+   // opposite direction is four directions on)
+
+   for (int square = 0; square < 64; ++square)
+   {
+      for (int direction = 0; direction < DIRECTION_COUNT; ++direction)
+      {
+         const Bitboard line = s_rays[direction][square]
+            | s_rays[(direction + SOUTH) % DIRECTION_COUNT][square]
+            | SquareMask((unsigned char)square);
+
+         Bitboard ray = s_rays[direction][square];
+         while (ray != 0)
+         {
+            const unsigned char to = PopLowestSquare(&ray);
+            s_between[square][to] = s_rays[direction][square]
+               & ~s_rays[direction][to] & ~SquareMask(to);
+            s_line[square][to] = line;
+         }
+      }
+   }
+
+   static const Direction rook_directions[4] = { NORTH, EAST, SOUTH, WEST };
+   static const Direction bishop_directions[4] =
+      { NORTHEAST, NORTHWEST, SOUTHWEST, SOUTHEAST };
+
+   // the rays must be filled before the magics, which are built from them
+   InitializeMagics(rook_directions, s_rook_magics, s_rook_table);
+   InitializeMagics(bishop_directions, s_bishop_magics, s_bishop_table);
+}
@@ -0,0 +1,280 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#ifndef SCRITTY_BITBOARD_H
+#define SCRITTY_BITBOARD_H
+
+#include <intrin.h>
+#include "scritty.h"
+
+// define SCRITTY_USE_PEXT to index the sliding attack tables with the BMI2
+// pext instruction (Haswell or later) instead of magic multiplication
+#ifdef SCRITTY_USE_PEXT
+#include <immintrin.h>
+#endif
+
+// squares are numbered a1 = 0, b1 = 1, ..., h8 = 63
+#define SQUARE(file, rank) ((unsigned char)((rank)*8 + (file)))
+#define SQUARE_FILE(square) ((unsigned char)((square) & 7))
+#define SQUARE_RANK(square) ((unsigned char)((square) >> 3))
+#define NO_SQUARE 64
+
+#define FILE_A_MASK 0x0101010101010101ull
+#define FILE_H_MASK 0x8080808080808080ull
+#define RANK_1_MASK 0x00000000000000ffull
+#define RANK_3_MASK 0x0000000000ff0000ull
+#define RANK_6_MASK 0x0000ff0000000000ull
+#define RANK_8_MASK 0xff00000000000000ull
+#define LIGHT_SQUARES_MASK 0x55aa55aa55aa55aaull // a1 is dark
+
+// sum over all squares of 2^(number of relevant blockers)
+#define ROOK_TABLE_SIZE 102400
+#define BISHOP_TABLE_SIZE 5248
+
+namespace scritty
+{
+   typedef unsigned __int64 Bitboard;
+
+   enum Side
+   {
+      WHITE,
+      BLACK
+   };
+
+   enum PieceType
+   {
+      PAWN,
+      KNIGHT,
+      BISHOP,
+      ROOK,
+      QUEEN,
+      KING,
+      PIECE_TYPE_COUNT
+   };
+
+   // index into the per-piece bitboards (black pieces follow white pieces in
+   // the same order)
+   enum PieceIndex
+   {
+      WHITE_PAWN,
+      WHITE_KNIGHT,
+      WHITE_BISHOP,
+      WHITE_ROOK,
+      WHITE_QUEEN,
+      WHITE_KING,
+      BLACK_PAWN,
+      BLACK_KNIGHT,
+      BLACK_BISHOP,
+      BLACK_ROOK,
+      BLACK_QUEEN,
+      BLACK_KING,
+      PIECE_INDEX_COUNT
+   };
+
+   inline int GetPieceIndex(char piece)
+   {
+      switch (piece)
+      {
+      case 'P': return WHITE_PAWN;
+      case 'N': return WHITE_KNIGHT;
+      case 'B': return WHITE_BISHOP;
+      case 'R': return WHITE_ROOK;
+      case 'Q': return WHITE_QUEEN;
+      case 'K': return WHITE_KING;
+      case 'p': return BLACK_PAWN;
+      case 'n': return BLACK_KNIGHT;
+      case 'b': return BLACK_BISHOP;
+      case 'r': return BLACK_ROOK;
+      case 'q': return BLACK_QUEEN;
+      case 'k': return BLACK_KING;
+      }
+
+      return PIECE_INDEX_COUNT; // not a piece
+   }
+
+   inline int GetPieceIndex(Side side, PieceType type)
+   {
+      return side*PIECE_TYPE_COUNT + type;
+   }
+
+   inline Bitboard SquareMask(unsigned char square)
+   {
+      return 1ull << square;
+   }
+
+   inline unsigned char LowestSquare(Bitboard b)
+   {
+      SCRITTY_ASSERT(b != 0);
+      unsigned long index;
+
+#ifdef _WIN64
+      _BitScanForward64(&index, b);
+#else
+      if (!_BitScanForward(&index, (unsigned long)b))
+      {
+         _BitScanForward(&index, (unsigned long)(b >> 32));
+         index += 32;
+      }
+#endif
+
+      return (unsigned char)index;
+   }
+
+   inline unsigned char HighestSquare(Bitboard b)
+   {
+      SCRITTY_ASSERT(b != 0);
+      unsigned long index;
+
+#ifdef _WIN64
+      _BitScanReverse64(&index, b);
+#else
+      if (_BitScanReverse(&index, (unsigned long)(b >> 32)))
+         index += 32;
+      else
+         _BitScanReverse(&index, (unsigned long)b);
+#endif
+
+      return (unsigned char)index;
+   }
+
+   inline unsigned char PopLowestSquare(Bitboard *b)
+   {
+      unsigned char square = LowestSquare(*b);
+      *b &= *b - 1;
+      return square;
+   }
+
+   inline unsigned int CountSquares(Bitboard b)
+   {
+#ifdef _WIN64
+      return (unsigned int)__popcnt64(b);
+#else
+      return __popcnt((unsigned int)b) + __popcnt((unsigned int)(b >> 32));
+#endif
+   }
+
+   class Bitboards
+   {
+   public:
+
+      static Bitboard KnightAttacks(unsigned char square)
+      {
+         return s_knight_attacks[square];
+      }
+
+      static Bitboard KingAttacks(unsigned char square)
+      {
+         return s_king_attacks[square];
+      }
+
+      // squares attacked by a pawn of the given side standing on square
+      static Bitboard PawnAttacks(Side side, unsigned char square)
+      {
+         return s_pawn_attacks[side][square];
+      }
+
+      static Bitboard RookAttacks(unsigned char square, Bitboard occupied)
+      {
+         const Magic &magic = s_rook_magics[square];
+         return magic.attacks[magic.GetIndex(occupied)];
+      }
+
+      static Bitboard BishopAttacks(unsigned char square, Bitboard occupied)
+      {
+         const Magic &magic = s_bishop_magics[square];
+         return magic.attacks[magic.GetIndex(occupied)];
+      }
+
+      static Bitboard QueenAttacks(unsigned char square, Bitboard occupied)
+      {
+         return RookAttacks(square, occupied)
+            | BishopAttacks(square, occupied);
+      }
+
+      // the squares strictly between two squares on a rank, file or diagonal
+      // (empty if the squares are not on one)
+      static Bitboard Between(unsigned char from, unsigned char to)
+      {
+         return s_between[from][to];
+      }
+
+      // the whole rank, file or diagonal through two squares (empty if the
+      // squares are not on one)
+      static Bitboard Line(unsigned char from, unsigned char to)
+      {
+         return s_line[from][to];
+      }
+
+   private:
+
+      // the first four directions step toward higher square numbers
+      enum Direction
+      {
+         NORTH,
+         NORTHEAST,
+         NORTHWEST,
+         EAST,
+         SOUTH,
+         SOUTHWEST,
+         SOUTHEAST,
+         WEST,
+         DIRECTION_COUNT
+      };
+
+      // the sliding attacks for one square are a slice of a shared table
+      // indexed by the blockers that matter (the relevant occupancy)
+      struct Magic
+      {
+         Bitboard mask; // relevant occupancy (board edges excluded)
+         Bitboard multiplier;
+         unsigned int shift;
+         Bitboard *attacks;
+
+         unsigned int GetIndex(Bitboard occupied) const
+         {
+#ifdef SCRITTY_USE_PEXT
+            return (unsigned int)_pext_u64(occupied, mask);
+#else
+            return (unsigned int)(((occupied & mask)*multiplier) >> shift);
+#endif
+         }
+      };
+
+      static Bitboard RayAttacks(
+         Direction direction, unsigned char square, Bitboard occupied)
+      {
+         // the ray stops at (and includes) the first blocker
+         Bitboard attacks = s_rays[direction][square];
+         Bitboard blockers = attacks & occupied;
+
+         if (blockers != 0)
+         {
+            unsigned char blocker = direction < SOUTH
+               ? LowestSquare(blockers) : HighestSquare(blockers);
+            attacks ^= s_rays[direction][blocker];
+         }
+
+         return attacks;
+      }
+
+      static void InitializeMagics(const Direction *directions,
+         Magic *magics, Bitboard *table);
+
+      Bitboards(); // fills the tables once at startup
+
+      static Bitboard s_knight_attacks[64];
+      static Bitboard s_king_attacks[64];
+      static Bitboard s_pawn_attacks[2][64];
+      static Bitboard s_rays[DIRECTION_COUNT][64];
+      static Bitboard s_between[64][64];
+      static Bitboard s_line[64][64];
+
+      static Magic s_rook_magics[64];
+      static Magic s_bishop_magics[64];
+      static Bitboard s_rook_table[ROOK_TABLE_SIZE];
+      static Bitboard s_bishop_table[BISHOP_TABLE_SIZE];
+
+      static Bitboards s_instance;
+   };
+}
+
+#endif // #ifndef SCRITTY_BITBOARD_H
@@ -6,7 +6,7 @@
 
 using namespace scritty;
 
-void Move::ToString(std::string *str)
+void Move::ToString(std::string *str) const
 {
    *str = start_file + 'a';
    *str += start_rank + '1';
@@ -17,27 +17,41 @@ void Move::ToString(std::string *str)
       *str += promotion_piece;
 }
 
-bool Move::operator==(const Move &other) const
+unsigned short Move::Pack() const
 {
-   return start_file == other.start_file
-      && start_rank == other.start_rank
-      && end_file == other.end_file
-      && end_rank == other.end_rank
-      && promotion_piece == other.promotion_piece;
+   static const char promotion_codes[] = "\0nbrq";
+
+   unsigned short promotion = 0;
+   if (promotion_piece != NO_PIECE)
+      promotion = (unsigned short)(
+         strchr(promotion_codes + 1, ::tolower(promotion_piece))
+         - promotion_codes);
+
+   return (unsigned short)(SQUARE(start_file, start_rank)
+      | (SQUARE(end_file, end_rank) << 6) | (promotion << 12));
 }
 
-Move& Move::operator=(const Move &rhs)
+void Move::Unpack(unsigned short packed)
 {
-   if (this != &rhs)
-   {
-      start_file = rhs.start_file;
-      start_rank = rhs.start_rank;
-      end_file = rhs.end_file;
-      end_rank = rhs.end_rank;
-      promotion_piece = rhs.promotion_piece;
-   }
+   static const char promotion_codes[] = "\0nbrq";
+
+   const unsigned char start = packed & 0x3f;
+   const unsigned char end = (packed >> 6) & 0x3f;
+
+   start_file = SQUARE_FILE(start);
+   start_rank = SQUARE_RANK(start);
+   end_file = SQUARE_FILE(end);
+   end_rank = SQUARE_RANK(end);
+
+   // the packed move may come from a table entry that was never checked, so
+   // an unknown code is taken as no promotion
+   const unsigned char promotion = (packed >> 12) & 7;
+   promotion_piece = promotion < sizeof(promotion_codes) - 1
+      ? promotion_codes[promotion] : NO_PIECE;
 
-   return *this;
+   // white promotes on the eighth rank
+   if (end_rank == 7)
+      promotion_piece = (char)::toupper(promotion_piece);
 }
 
 bool Engine::ApplyMove(const std::string &str)
@@ -6,12 +6,42 @@
 #include "Position.h"
 #include "scritty.h"
 
+// the UCI "Hash" option covers all of an engine's tables
+#define DEFAULT_HASH_MEGABYTES 16
+#ifdef _WIN64
+#define MAX_HASH_MEGABYTES 65536
+#else
+#define MAX_HASH_MEGABYTES 1024
+#endif
+
 namespace scritty
 {
+   // what the GUI allows for the next search (zero for no limit)
+   class SearchLimits
+   {
+   public:
+      SearchLimits() : depth(0), nodes(0), move_time(0), white_time(0),
+         black_time(0), white_increment(0), black_increment(0),
+         moves_to_go(0), infinite(false), ponder(false)
+      {
+      }
+
+      size_t depth;
+      unsigned __int64 nodes;
+      unsigned __int64 move_time; // milliseconds
+      unsigned __int64 white_time; // milliseconds left on each clock
+      unsigned __int64 black_time;
+      unsigned __int64 white_increment; // milliseconds per move
+      unsigned __int64 black_increment;
+      size_t moves_to_go; // to the next time control (zero if sudden death)
+      bool infinite; // no limits, and no result until the search is stopped
+      bool ponder; // on the opponent's time, so no limits until a ponder hit
+   };
+
    class Engine
    {
    public:
-      Engine() : m_position_chain(new Position[MAX_POSITION_CHAIN_LEN]),
+      Engine() : m_position_chain(new UndoRecord[MAX_POSITION_CHAIN_LEN]),
             m_position_chain_length(new size_t),
             m_position_table(new PositionTable)
       {
@@ -40,20 +70,51 @@ namespace scritty
       }
 
       void StartNewGame() { m_position->SetToStartPos(); }
+      bool StartNewGameFromFen(const std::string &fen)
+      {
+         return m_position->SetToFen(fen);
+      }
       bool ApplyMove(const std::string &str); // algebraic notation
       char GetPieceAt(const std::string &square) const; // algebraic notation
       bool IsWhiteToMove() const;
       Outcome GetOutcome() const;
       const Position &GetPosition() const;
 
+      // resizing clears the tables
+      virtual void SetHashSize(size_t megabytes)
+      {
+         m_position_table->Resize(megabytes);
+      }
+
+      virtual void SetThreadCount(size_t /*thread_count*/) {} // no threads
+
+      // the limits apply to every later search until they are set again
+      // (setting them also forgets any stop meant for an earlier search)
+      virtual void SetSearchLimits(
+         const SearchLimits & /*limits*/) {} // no search
+
+      // safe to call from another thread while GetBestMove is searching
+      // the search still returns a move, so it may not stop at once
+      virtual void StopSearch() {} // no search to stop
+
+      // the opponent played the move pondered on, so the search goes on under
+      // its limits from now (also safe to call while GetBestMove is searching)
+      virtual void PonderHit() {} // no search to continue
+
       // returns a draw outcome if engine is *offering* a draw
       // returns win for other side on resignation
       // don't call if there are no valid moves
       virtual Outcome GetBestMove(std::string *best) const = 0; // algebraic
 
+      // the reply expected to the last best move, or empty if there is none
+      virtual void GetPonderMove(std::string *ponder) const
+      {
+         ponder->clear();
+      }
+
    protected:
       Position *m_position;
-      Position *m_position_chain;
+      UndoRecord *m_position_chain;
       size_t *m_position_chain_length;
       PositionTable *m_position_table;
 
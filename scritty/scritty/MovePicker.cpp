@@ -0,0 +1,284 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#include "MovePicker.h"
+#include <climits>
+
+using namespace scritty;
+
+void MoveHistory::Clear()
+{
+   memset(m_history, 0, sizeof(m_history));
+   memset(m_counter_moves, 0, sizeof(m_counter_moves)); // a1a1 is never legal
+}
+
+void MoveHistory::Update(
+   const Position &position, const Move &move, size_t depth)
+{
+   // deep cutoffs count for more, since they save more
+
+   int &score = m_history[position.IsWhiteToMove() ? WHITE : BLACK]
+      [SQUARE(move.start_file, move.start_rank)]
+      [SQUARE(move.end_file, move.end_rank)];
+   score += (int)(depth*depth);
+
+   // old cutoffs fade, so the table follows the search
+   if (score > MAX_HISTORY_SCORE)
+      for (size_t side = 0; side < 2; ++side)
+         for (size_t from = 0; from < 64; ++from)
+            for (size_t to = 0; to < 64; ++to)
+               m_history[side][from][to] /= 2;
+
+   Move previous;
+   if (position.GetLastMove(&previous))
+      m_counter_moves[SQUARE(previous.start_file, previous.start_rank)]
+         [SQUARE(previous.end_file, previous.end_rank)] = move;
+}
+
+bool MoveHistory::GetCounterMove(const Position &position, Move *move) const
+{
+   Move previous;
+   if (!position.GetLastMove(&previous))
+      return false;
+
+   *move = m_counter_moves[SQUARE(previous.start_file, previous.start_rank)]
+      [SQUARE(previous.end_file, previous.end_rank)];
+   return true;
+}
+
+MovePicker::MovePicker(const Position &position, const Move *suggestion,
+   ScoredMoveList *list, bool captures_only /*= false*/)
+   : m_position(position), m_has_suggestion(false),
+   m_captures_only(captures_only), m_stage(STAGE_SUGGESTION),
+   m_history(nullptr), m_killer_moves(nullptr), m_killer_count(0),
+   m_killer_index(0),
+   m_buf(list->moves), m_scores(list->scores), m_capture_count(0),
+   m_move_count(0), m_index(0), m_quiet_index(0)
+{
+   // a suggestion that is not a capture is not wanted with captures only
+   if (suggestion != nullptr
+      && position.IsMoveLegal(*suggestion)
+      && (!captures_only || GetCaptureOrder(position, *suggestion) > 0))
+   {
+      m_suggestion = *suggestion;
+      m_has_suggestion = true;
+   }
+}
+
+MovePicker::MovePicker(const Position &position, const Move *suggestion,
+   ScoredMoveList *list, const Move *killers, const MoveHistory *history)
+   : m_position(position), m_has_suggestion(false), m_captures_only(false),
+   m_stage(STAGE_SUGGESTION), m_history(history), m_killer_moves(killers),
+   m_killer_count(0), m_killer_index(0), m_buf(list->moves),
+   m_scores(list->scores), m_capture_count(0), m_move_count(0), m_index(0),
+   m_quiet_index(0)
+{
+   if (suggestion != nullptr && position.IsMoveLegal(*suggestion))
+   {
+      m_suggestion = *suggestion;
+      m_has_suggestion = true;
+   }
+}
+
+bool MovePicker::Next(Move *move)
+{
+   for (;;)
+   {
+      switch (m_stage)
+      {
+      case STAGE_SUGGESTION:
+         m_stage = STAGE_GENERATE_CAPTURES;
+         if (m_has_suggestion)
+         {
+            *move = m_suggestion;
+            return true;
+         }
+         break;
+
+      case STAGE_GENERATE_CAPTURES:
+         m_capture_count = m_position.ListCaptures(m_buf);
+         m_move_count = m_capture_count;
+
+         for (size_t i = 0; i < m_capture_count; ++i)
+         {
+            m_scores[i] = GetCaptureOrder(m_position, m_buf[i]);
+            if (IsLosingCapture(m_buf[i]))
+               m_scores[i] -= LOSING_CAPTURE_PENALTY;
+         }
+
+         m_index = 0;
+         m_stage = STAGE_WINNING_CAPTURES;
+         break;
+
+      case STAGE_WINNING_CAPTURES:
+         if (PickBest(&m_index, m_capture_count, 0, move))
+            return true;
+         m_stage = m_captures_only
+            ? STAGE_LOSING_CAPTURES : STAGE_GENERATE_KILLERS;
+         break;
+
+      case STAGE_GENERATE_KILLERS:
+         GenerateKillers();
+         m_killer_index = 0;
+         m_stage = STAGE_KILLERS;
+         break;
+
+      case STAGE_KILLERS:
+         if (m_killer_index < m_killer_count)
+         {
+            *move = m_killers[m_killer_index++];
+            return true;
+         }
+         m_stage = STAGE_GENERATE_QUIET_MOVES;
+         break;
+
+      case STAGE_GENERATE_QUIET_MOVES:
+         // the losing captures stay where they are until their turn
+         m_move_count = m_capture_count
+            + m_position.ListQuietMoves(m_buf + m_capture_count);
+         SCRITTY_ASSERT(m_move_count <= MAX_NUMBER_OF_LEGAL_MOVES);
+
+         for (size_t i = m_capture_count; i < m_move_count; ++i)
+            m_scores[i] = m_history != nullptr
+               ? m_history->GetScore(m_position, m_buf[i]) : 0;
+
+         m_quiet_index = m_capture_count;
+         m_stage = STAGE_QUIET_MOVES;
+         break;
+
+      case STAGE_QUIET_MOVES:
+         if (PickBest(&m_quiet_index, m_move_count, INT_MIN, move))
+            return true;
+         m_stage = STAGE_LOSING_CAPTURES;
+         break;
+
+      case STAGE_LOSING_CAPTURES:
+         if (PickBest(&m_index, m_capture_count, -LOSING_CAPTURE_PENALTY*2,
+            move))
+            return true;
+         m_stage = STAGE_DONE;
+         break;
+
+      case STAGE_DONE:
+         return false;
+      }
+   }
+}
+
+void MovePicker::GenerateKillers()
+{
+   // the killers and the counter-move are only guesses from elsewhere in
+   // the tree, so each must be checked, and captures come earlier anyway
+
+   if (m_killer_moves == nullptr)
+      return;
+
+   Move candidates[KILLER_SLOTS + 1];
+   size_t candidate_count = 0;
+
+   for (size_t i = 0; i < KILLER_SLOTS; ++i)
+      candidates[candidate_count++] = m_killer_moves[i];
+   if (m_history->GetCounterMove(m_position, candidates + candidate_count))
+      ++candidate_count;
+
+   for (size_t i = 0; i < candidate_count; ++i)
+   {
+      const Move &candidate = candidates[i];
+
+      if (IsAlreadyPicked(candidate)
+         || !m_position.IsMoveLegal(candidate)
+         || GetCaptureOrder(m_position, candidate) > 0)
+         continue;
+
+      m_killers[m_killer_count++] = candidate;
+   }
+}
+
+bool MovePicker::PickBest(
+   size_t *index, size_t end, int min_score, Move *move)
+{
+   // a selection sort step at a time, since a cutoff usually comes after
+   // only a few moves
+
+   while (*index < end)
+   {
+      size_t best = *index;
+      for (size_t i = *index + 1; i < end; ++i)
+         if (m_scores[i] > m_scores[best])
+            best = i;
+
+      if (m_scores[best] < min_score)
+         return false;
+
+      const Move best_move = m_buf[best];
+      const int best_score = m_scores[best];
+      m_buf[best] = m_buf[*index];
+      m_scores[best] = m_scores[*index];
+      m_buf[*index] = best_move;
+      m_scores[*index] = best_score;
+      ++*index;
+
+      if (!IsAlreadyPicked(best_move))
+      {
+         *move = best_move;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+bool MovePicker::IsAlreadyPicked(const Move &move) const
+{
+   if (m_has_suggestion && move == m_suggestion)
+      return true;
+
+   for (size_t i = 0; i < m_killer_count; ++i)
+      if (move == m_killers[i])
+         return true;
+
+   return false;
+}
+
+/*static*/ int MovePicker::GetCaptureOrder(
+   const Position &position, const Move &move)
+{
+   // a promotion adds its piece as if it were captured
+
+   const char piece = position.GetPieceAt(move.start_file, move.start_rank);
+   const char captured = position.GetPieceAt(move.end_file, move.end_rank);
+   const int attacker = GetPieceIndex(piece) % PIECE_TYPE_COUNT;
+
+   int victim = 0;
+
+   if (captured != NO_PIECE)
+      victim = GetPieceIndex(captured) % PIECE_TYPE_COUNT + 1;
+   else if (attacker == PAWN && move.start_file != move.end_file)
+      victim = PAWN + 1; // en passant
+
+   if (move.promotion_piece != NO_PIECE)
+      victim += GetPieceIndex((char)::toupper(move.promotion_piece))
+         % PIECE_TYPE_COUNT;
+
+   if (victim == 0)
+      return 0;
+
+   return victim*PIECE_TYPE_COUNT + KING - attacker;
+}
+
+bool MovePicker::IsLosingCapture(const Move &move) const
+{
+   // taking a piece worth at least the capturer cannot lose, which saves
+   // most of the exchange evaluations
+
+   const char captured = m_position.GetPieceAt(move.end_file, move.end_rank);
+   const char piece = m_position.GetPieceAt(move.start_file, move.start_rank);
+
+   if (captured != NO_PIECE && move.promotion_piece == NO_PIECE
+      && Position::GetExchangeValue(
+      (PieceType)(GetPieceIndex(piece) % PIECE_TYPE_COUNT))
+      <= Position::GetExchangeValue(
+      (PieceType)(GetPieceIndex(captured) % PIECE_TYPE_COUNT)))
+      return false;
+
+   return m_position.EvaluateExchange(move) < 0;
+}
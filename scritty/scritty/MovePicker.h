@@ -0,0 +1,130 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#ifndef SCRITTY_MOVE_PICKER_H
+#define SCRITTY_MOVE_PICKER_H
+
+#include "Position.h"
+
+#define LOSING_CAPTURE_PENALTY 1000 // puts losing captures below all others
+#define KILLER_SLOTS 2 // quiet moves remembered per ply
+#define MAX_HISTORY_SCORE 100000 // the table is halved when one gets past
+
+namespace scritty
+{
+   enum MovePickerStage
+   {
+      STAGE_SUGGESTION,
+      STAGE_GENERATE_CAPTURES,
+      STAGE_WINNING_CAPTURES,
+      STAGE_GENERATE_KILLERS,
+      STAGE_KILLERS, // and then the counter-move
+      STAGE_GENERATE_QUIET_MOVES,
+      STAGE_QUIET_MOVES,
+      STAGE_LOSING_CAPTURES,
+      STAGE_DONE
+   };
+
+   // moves with a score each, for ordering them (the scores are kept apart,
+   // so that the moves can be generated straight into the list)
+   struct ScoredMoveList
+   {
+      Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+      int scores[MAX_NUMBER_OF_LEGAL_MOVES];
+   };
+
+   // what a search thread has learned about quiet moves, for ordering them
+   // (the killers are kept by the search, since they are per ply)
+   class MoveHistory
+   {
+   public:
+      MoveHistory() { Clear(); }
+
+      void Clear();
+
+      // a quiet move caused a cutoff after the previous move, searched to
+      // the given depth
+      void Update(const Position &position, const Move &move, size_t depth);
+
+      int GetScore(const Position &position, const Move &move) const
+      {
+         return m_history[position.IsWhiteToMove() ? WHITE : BLACK]
+            [SQUARE(move.start_file, move.start_rank)]
+            [SQUARE(move.end_file, move.end_rank)];
+      }
+
+      // false if there is none for the previous move
+      bool GetCounterMove(const Position &position, Move *move) const;
+
+   private:
+      MoveHistory(const MoveHistory &); // copy disallowed
+
+      int m_history[2][64][64]; // by side, start square and end square
+
+      // the reply that refuted each move, by its start and end squares
+      Move m_counter_moves[64][64];
+   };
+
+   // hands out the moves of a position in the order they are most likely to
+   // cause a cutoff, generating each stage only when the stages before it are
+   // used up, so a cutoff saves generating the rest
+   // every move is legal (the suggestion is checked, since it may come from
+   // elsewhere)
+   class MovePicker
+   {
+   public:
+      MovePicker(const Position &position, const Move *suggestion,
+         ScoredMoveList *list, bool captures_only = false);
+
+      // also orders the quiet moves, the killers (KILLER_SLOTS of them) and
+      // the counter-move first and the rest by their history
+      MovePicker(const Position &position, const Move *suggestion,
+         ScoredMoveList *list, const Move *killers,
+         const MoveHistory *history);
+
+      bool Next(Move *move); // false when no moves are left
+
+      MovePickerStage GetStage() const { return m_stage; }
+
+      // zero for a quiet move, otherwise higher for a more valuable victim
+      // and then for a less valuable attacker (MVV-LVA)
+      static int GetCaptureOrder(const Position &position, const Move &move);
+
+   private:
+      MovePicker(const MovePicker &); // copy disallowed
+
+      // by static exchange evaluation
+      bool IsLosingCapture(const Move &move) const;
+
+      // the legal quiet ones of the killers and the counter-move
+      void GenerateKillers();
+
+      // swaps the best move left in m_buf from *index to end to *index,
+      // unless below min_score
+      bool PickBest(size_t *index, size_t end, int min_score, Move *move);
+
+      // true if the move was handed out before its stage
+      bool IsAlreadyPicked(const Move &move) const;
+
+      const Position &m_position;
+      Move m_suggestion;
+      bool m_has_suggestion;
+      bool m_captures_only;
+      MovePickerStage m_stage;
+
+      const MoveHistory *m_history; // null for no quiet move ordering
+      const Move *m_killer_moves; // as given, checked only at their stage
+      Move m_killers[KILLER_SLOTS + 1]; // and the counter-move
+      size_t m_killer_count;
+      size_t m_killer_index;
+
+      // the captures followed by the quiet moves, in the list
+      Move *m_buf;
+      int *m_scores;
+      size_t m_capture_count;
+      size_t m_move_count;
+      size_t m_index; // the next capture
+      size_t m_quiet_index; // the next quiet move
+   };
+}
+
+#endif // #ifndef SCRITTY_MOVE_PICKER_H
@@ -0,0 +1,259 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#include "Perft.h"
+#include "RandomEngine.h"
+#include <iostream>
+#include <Windows.h>
+
+using namespace scritty;
+
+struct PerftPosition
+{
+   const char *name;
+   const char *fen;
+   size_t depth;
+   unsigned __int64 nodes;
+};
+
+// see http://chessprogramming.wikispaces.com/Perft+Results
+static const PerftPosition s_suite[] =
+{
+   { "start position",
+   "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+   5, 4865609ull },
+   { "kiwipete",
+   "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+   4, 4085603ull },
+   { "position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+   6, 11030083ull },
+   { "position 4",
+   "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+   5, 15833292ull },
+   { "position 5",
+   "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+   4, 2103487ull },
+   { "position 6",
+   "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+   4, 3894594ull }
+};
+
+// each position is saved under its key mixed with the remaining depth
+static HashKey PerftKey(HashKey key, size_t depth)
+{
+   return key ^ (depth*0x9e3779b97f4a7c15ull);
+}
+
+PerftTable::PerftTable(size_t megabytes /*= DEFAULT_PERFT_TABLE_MEGABYTES*/)
+{
+   m_entry_count = megabytes*1024*1024 / sizeof(Entry);
+   if (m_entry_count == 0)
+      m_entry_count = 1;
+
+   m_entries = new Entry[m_entry_count];
+   memset((void*)m_entries, 0, m_entry_count*sizeof(Entry));
+}
+
+PerftTable::~PerftTable()
+{
+   delete[] m_entries;
+}
+
+bool PerftTable::Lookup(
+   HashKey key, size_t depth, unsigned __int64 *nodes) const
+{
+   key = PerftKey(key, depth);
+   const Entry &entry = m_entries[GetIndex(key)];
+
+   const unsigned __int64 data = entry.data;
+   const unsigned __int64 check = entry.check;
+
+   if ((check ^ data) != key || (data & 0xff) != depth)
+      return false;
+
+   *nodes = data >> 8;
+   return true;
+}
+
+void PerftTable::Save(HashKey key, size_t depth, unsigned __int64 nodes)
+{
+   SCRITTY_ASSERT(depth <= 0xff);
+   key = PerftKey(key, depth);
+   Entry &entry = m_entries[GetIndex(key)];
+
+   // always replace; deeper counts are found again before shallower ones
+   const unsigned __int64 data = (nodes << 8) | depth;
+   entry.check = key ^ data;
+   entry.data = data;
+}
+
+/*static*/ unsigned __int64 Perft::Count(const Position &position,
+   size_t depth, PerftTable *table /*= nullptr*/)
+{
+   if (depth == 0)
+      return 1;
+
+   unsigned __int64 nodes = 0;
+
+   // the last ply is cheaper to count than to look up
+   if (table != nullptr && depth > 1
+      && table->Lookup(position.GetHash(), depth, &nodes))
+   {
+      return nodes;
+   }
+
+   Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+   const size_t move_count = position.GenerateLegalMoves(moves);
+
+   // bulk count at the last ply rather than making each move
+   if (depth == 1)
+      return move_count;
+
+   for (size_t i = 0; i < move_count; ++i)
+   {
+      Position& must_roll_back = const_cast<Position&>(position);
+      must_roll_back.ApplyKnownLegalMove(moves[i]);
+      nodes += Count(must_roll_back, depth - 1, table);
+      must_roll_back.RollBackOneMove();
+   }
+
+   if (table != nullptr)
+      table->Save(position.GetHash(), depth, nodes);
+
+   return nodes;
+}
+
+struct PerftJob
+{
+   const Position *root;
+   Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+   size_t move_count;
+   unsigned __int64 move_nodes[MAX_NUMBER_OF_LEGAL_MOVES];
+   volatile LONG next_move; // the next root move for a thread to take
+   size_t depth;
+   PerftTable *table;
+};
+
+static void CountRootMoves(void *context, size_t /*thread_index*/)
+{
+   PerftJob *job = (PerftJob*)context;
+
+   // each thread makes moves on its own copy of the root
+   UndoRecord *chain = new UndoRecord[MAX_POSITION_CHAIN_LEN];
+   size_t chain_length = 0;
+   Position position(chain, &chain_length, nullptr);
+   position.SetToPosition(*job->root);
+
+   for (;;)
+   {
+      const size_t i = (size_t)(::InterlockedIncrement(&job->next_move) - 1);
+      if (i >= job->move_count)
+         break;
+
+      position.ApplyKnownLegalMove(job->moves[i]);
+      job->move_nodes[i] = Perft::Count(position, job->depth - 1, job->table);
+      position.RollBackOneMove();
+   }
+
+   delete[] chain;
+}
+
+/*static*/ unsigned __int64 Perft::CountInParallel(const Position &position,
+   size_t depth, ThreadPool *pool, PerftTable *table /*= nullptr*/,
+   unsigned __int64 *move_nodes /*= nullptr*/)
+{
+   if (depth == 0)
+      return 1;
+
+   PerftJob *job = new PerftJob;
+   job->root = &position;
+   job->move_count = position.GenerateLegalMoves(job->moves);
+   job->next_move = 0;
+   job->depth = depth;
+   job->table = table;
+
+   pool->Start(CountRootMoves, job);
+   pool->Wait();
+
+   unsigned __int64 nodes = 0;
+   for (size_t i = 0; i < job->move_count; ++i)
+   {
+      nodes += job->move_nodes[i];
+      if (move_nodes != nullptr)
+         move_nodes[i] = job->move_nodes[i];
+   }
+
+   delete job;
+   return nodes;
+}
+
+/*static*/ unsigned __int64 Perft::Run(const Position &position, size_t depth,
+   bool divide, ThreadPool *pool, PerftTable *table /*= nullptr*/)
+{
+   const ULONGLONG start_tick_count = ::GetTickCount64();
+
+   unsigned __int64 move_nodes[MAX_NUMBER_OF_LEGAL_MOVES];
+   const unsigned __int64 nodes
+      = CountInParallel(position, depth, pool, table, move_nodes);
+
+   if (divide && depth > 0)
+   {
+      Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+      const size_t move_count = position.GenerateLegalMoves(moves);
+
+      for (size_t i = 0; i < move_count; ++i)
+      {
+         std::string move;
+         moves[i].ToString(&move);
+         std::cout << move << ": " << move_nodes[i] << std::endl;
+      }
+   }
+
+   const ULONGLONG milliseconds = ::GetTickCount64() - start_tick_count;
+
+   std::cout << "perft " << depth << ": " << nodes << " nodes in "
+      << milliseconds << " ms";
+   if (milliseconds > 0)
+      std::cout << " (" << 1000*nodes / milliseconds << " nps)";
+   std::cout << std::endl;
+
+   return nodes;
+}
+
+/*static*/ bool Perft::RunSuite(ThreadPool *pool)
+{
+   bool all_passed = true;
+   unsigned __int64 total_nodes = 0;
+   const ULONGLONG start_tick_count = ::GetTickCount64();
+
+   for (size_t i = 0; i < sizeof(s_suite) / sizeof(s_suite[0]); ++i)
+   {
+      RandomEngine engine;
+      if (!engine.StartNewGameFromFen(s_suite[i].fen))
+      {
+         std::cout << s_suite[i].name << ": bad fen" << std::endl;
+         all_passed = false;
+         continue;
+      }
+
+      std::cout << s_suite[i].name << std::endl;
+      const unsigned __int64 nodes
+         = Run(engine.GetPosition(), s_suite[i].depth, false, pool);
+      total_nodes += nodes;
+
+      if (nodes != s_suite[i].nodes)
+      {
+         std::cout << "FAILED: expected " << s_suite[i].nodes << std::endl;
+         all_passed = false;
+      }
+   }
+
+   const ULONGLONG milliseconds = ::GetTickCount64() - start_tick_count;
+
+   std::cout << (all_passed ? "Perft suite passed: " : "Perft suite FAILED: ")
+      << total_nodes << " nodes in " << milliseconds << " ms";
+   if (milliseconds > 0)
+      std::cout << " (" << 1000*total_nodes / milliseconds << " nps)";
+   std::cout << std::endl;
+
+   return all_passed;
+}
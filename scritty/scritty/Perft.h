@@ -0,0 +1,69 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#ifndef SCRITTY_PERFT_H
+#define SCRITTY_PERFT_H
+
+#include "Position.h"
+#include "ThreadPool.h"
+
+#define DEFAULT_PERFT_TABLE_MEGABYTES 64
+
+namespace scritty
+{
+   // subtree counts shared by all perft threads without locking
+   class PerftTable
+   {
+   public:
+      PerftTable(size_t megabytes = DEFAULT_PERFT_TABLE_MEGABYTES);
+      ~PerftTable();
+
+      bool Lookup(HashKey key, size_t depth, unsigned __int64 *nodes) const;
+      void Save(HashKey key, size_t depth, unsigned __int64 nodes);
+
+   private:
+      PerftTable(const PerftTable &); // copy disallowed
+
+      // check is the key xor data, so an entry torn by two threads writing
+      // at once fails the check on lookup instead of returning a bad count
+      struct Entry
+      {
+         volatile unsigned __int64 check;
+         volatile unsigned __int64 data; // nodes in the high 56 bits, depth
+      };
+
+      size_t GetIndex(HashKey key) const
+      {
+         return (size_t)(((key >> 32)*m_entry_count) >> 32);
+      }
+
+      Entry *m_entries;
+      size_t m_entry_count;
+   };
+
+   // counts the leaves of the legal move tree, for checking move generation
+   // against known counts and for measuring its speed
+   class Perft
+   {
+   public:
+      static unsigned __int64 Count(const Position &position, size_t depth,
+         PerftTable *table = nullptr);
+
+      // the root moves are shared out to the threads of the pool
+      // move_nodes (if given) gets the count below each root move, in the
+      // order of GenerateLegalMoves
+      static unsigned __int64 CountInParallel(const Position &position,
+         size_t depth, ThreadPool *pool, PerftTable *table = nullptr,
+         unsigned __int64 *move_nodes = nullptr);
+
+      // prints the count and speed, and with divide the count below each move
+      static unsigned __int64 Run(const Position &position, size_t depth,
+         bool divide, ThreadPool *pool, PerftTable *table = nullptr);
+
+      // runs standard positions with known counts (without a table, so the
+      // speed is that of move generation)
+      // returns false if any count is wrong
+      static bool RunSuite(ThreadPool *pool);
+   };
+}
+
+#endif // #ifndef SCRITTY_PERFT_H
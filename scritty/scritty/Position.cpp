@@ -2,6 +2,8 @@
 
 #include "Position.h"
 #include "scritty.h"
+#include <sstream>
+#include <algorithm>
 
 using namespace scritty;
 
@@ -17,163 +19,438 @@ void Position::SetToStartPos()
       "NP\0\0\0\0pn"
       "RP\0\0\0\0pr", sizeof(m_squares));
 
-   m_white_to_move = true;
-
-   m_white_may_castle_short = true;
-   m_white_may_castle_long = true;
-   m_black_may_castle_short = true;
-   m_black_may_castle_long = true;
+   SynchronizeBitboards();
 
+   m_white_to_move = true;
+   m_castle_rights = ALL_CASTLE_RIGHTS;
    m_en_passant_allowed_on = NO_EN_PASSANT;
+   m_halfmove_clock = 0;
+   m_plies_from_null = 0;
 
    *m_chain_length = 0;
 
-   m_hash = POSITION_HASH_MODULUS;
+   m_hash = CalculateHash();
+   m_checkers = 0;
 }
 
-void Position::RollBackOneMove()
+bool Position::SetToFen(const std::string &fen)
 {
-   // there must be a move to roll back!
+   // see http://en.wikipedia.org/wiki/Forsyth%E2%80%93Edwards_Notation
+   // e.g. rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1
+   // (the move counters may be left off)
 
-   Position *previous = m_chain + *m_chain_length - 1;
+   std::stringstream ss(fen);
+   std::string placement, side, castling, en_passant;
+   unsigned int halfmove_clock = 0;
 
-   m_white_to_move = previous->m_white_to_move;
-   m_white_may_castle_short = previous->m_white_may_castle_short;
-   m_white_may_castle_long = previous->m_white_may_castle_long;
-   m_black_may_castle_short = previous->m_black_may_castle_short;
-   m_black_may_castle_long = previous->m_black_may_castle_long;
-   m_en_passant_allowed_on = previous->m_en_passant_allowed_on;
+   if (!(ss >> placement >> side >> castling >> en_passant))
+      return false;
+   ss >> halfmove_clock;
 
-   memcpy(m_squares, previous->m_squares, sizeof(previous->m_squares));
+   // ranks are listed from the eighth down, files from a to h
 
-   --(*m_chain_length);
+   char squares[8][8];
+   memset(squares, NO_PIECE, sizeof(squares));
 
-   m_hash = POSITION_HASH_MODULUS;
-}
+   int file = 0, rank = 7;
+   for (size_t i = 0; i < placement.size(); ++i)
+   {
+      const char c = placement[i];
 
-void Position::ApplyKnownLegalMove(const Move &move)
-{
-   // save position (for various draw rules)
-   SCRITTY_ASSERT(*m_chain_length < MAX_POSITION_CHAIN_LEN);
-   m_chain[(*m_chain_length)++] = *this; // copy to chain
+      if (c == '/')
+      {
+         if (file != 8 || rank == 0)
+            return false;
+         file = 0;
+         --rank;
+      }
+      else if (c >= '1' && c <= '8')
+      {
+         file += c - '0';
+         if (file > 8)
+            return false;
+      }
+      else
+      {
+         if (GetPieceIndex(c) == PIECE_INDEX_COUNT || file > 7)
+            return false;
+         squares[file++][rank] = c;
+      }
+   }
 
-   // move the piece
-   m_squares[move.end_file][move.end_rank]
-   = m_squares[move.start_file][move.start_rank];
-   m_squares[move.start_file][move.start_rank] = NO_PIECE;
+   if (file != 8 || rank != 0)
+      return false;
 
-   // handle castle rules
+   // move generation needs exactly one king on each side
+   if (std::count(placement.begin(), placement.end(), 'K') != 1
+      || std::count(placement.begin(), placement.end(), 'k') != 1)
+      return false;
 
-   char piece = m_squares[move.end_file][move.end_rank];
+   if (side != "w" && side != "b")
+      return false;
 
-   if (move.start_rank == 0)
+   unsigned char castle_rights = 0;
+   if (castling != "-")
    {
-      if (move.start_file == 0)
-      {
-         m_white_may_castle_long = false;
-      }
-      else if (move.start_file == 7)
-      {
-         m_white_may_castle_short = false;
-      }
-      else if (move.start_file == 4)
+      for (size_t i = 0; i < castling.size(); ++i)
       {
-         // possibly move rook
-         if (piece == 'K')
+         switch (castling[i])
          {
-            if (move.end_file == 2)
-            {
-               m_squares[0][0] = NO_PIECE;
-               m_squares[3][0] = 'R';
-            }
-            else if (move.end_file == 6)
-            {
-               m_squares[7][0] = NO_PIECE;
-               m_squares[5][0] = 'R';
-            }
-
-            m_white_may_castle_long = false;
-            m_white_may_castle_short = false;
+         case 'K': castle_rights |= WHITE_CASTLE_SHORT; break;
+         case 'Q': castle_rights |= WHITE_CASTLE_LONG; break;
+         case 'k': castle_rights |= BLACK_CASTLE_SHORT; break;
+         case 'q': castle_rights |= BLACK_CASTLE_LONG; break;
+         default: return false;
          }
       }
    }
-   else if (move.start_rank == 7)
+
+   // a right is dropped unless the king and the rook are still at home, so
+   // that a castle always finds its pieces
+   if (squares[4][0] != 'K')
+      castle_rights &= ~(WHITE_CASTLE_SHORT | WHITE_CASTLE_LONG);
+   if (squares[7][0] != 'R')
+      castle_rights &= ~WHITE_CASTLE_SHORT;
+   if (squares[0][0] != 'R')
+      castle_rights &= ~WHITE_CASTLE_LONG;
+   if (squares[4][7] != 'k')
+      castle_rights &= ~(BLACK_CASTLE_SHORT | BLACK_CASTLE_LONG);
+   if (squares[7][7] != 'r')
+      castle_rights &= ~BLACK_CASTLE_SHORT;
+   if (squares[0][7] != 'r')
+      castle_rights &= ~BLACK_CASTLE_LONG;
+
+   // the FEN names the square passed over, but only its file is kept
+   unsigned char en_passant_allowed_on = NO_EN_PASSANT;
+   if (en_passant != "-")
    {
-      if (move.start_file == 0)
-      {
-         m_black_may_castle_long = false;
-      }
-      else if (move.start_file == 7)
+      if (en_passant.size() != 2 || en_passant[0] < 'a' || en_passant[0] > 'h'
+         || (en_passant[1] != '3' && en_passant[1] != '6'))
+         return false;
+      en_passant_allowed_on = en_passant[0] - 'a';
+   }
+
+   memcpy(m_squares, squares, sizeof(m_squares));
+   SynchronizeBitboards();
+
+   m_white_to_move = side == "w";
+   m_castle_rights = castle_rights;
+   m_en_passant_allowed_on = en_passant_allowed_on;
+   m_halfmove_clock = (unsigned short)halfmove_clock;
+   m_plies_from_null = 0;
+
+   *m_chain_length = 0;
+
+   m_hash = CalculateHash();
+   m_checkers = FindCheckers();
+
+   return true;
+}
+
+void Position::SetToPosition(const Position &other)
+{
+   memcpy(m_squares, other.m_squares, sizeof(m_squares));
+   memcpy(m_pieces, other.m_pieces, sizeof(m_pieces));
+   memcpy(m_side_pieces, other.m_side_pieces, sizeof(m_side_pieces));
+
+   m_white_to_move = other.m_white_to_move;
+   m_castle_rights = other.m_castle_rights;
+   m_en_passant_allowed_on = other.m_en_passant_allowed_on;
+   m_halfmove_clock = other.m_halfmove_clock;
+   m_plies_from_null = other.m_plies_from_null;
+
+   // only the moves since the last capture or pawn move can be repeated, so
+   // only they are copied (and so only they can be rolled back)
+
+   const size_t other_length = *other.m_chain_length;
+   const size_t reversible_moves = other.m_halfmove_clock < other_length
+      ? other.m_halfmove_clock : other_length;
+
+   memcpy(m_chain, other.m_chain + other_length - reversible_moves,
+      reversible_moves*sizeof(UndoRecord));
+   *m_chain_length = reversible_moves;
+
+   m_hash = other.m_hash;
+   m_checkers = other.m_checkers;
+}
+
+static unsigned char CastleRightsLostOn(unsigned char file, unsigned char rank)
+{
+   // moving from or to these squares means the king or a rook has moved or
+   // a rook has been captured
+
+   switch (SQUARE(file, rank))
+   {
+   case SQUARE(0, 0): return WHITE_CASTLE_LONG;
+   case SQUARE(4, 0): return WHITE_CASTLE_LONG | WHITE_CASTLE_SHORT;
+   case SQUARE(7, 0): return WHITE_CASTLE_SHORT;
+   case SQUARE(0, 7): return BLACK_CASTLE_LONG;
+   case SQUARE(4, 7): return BLACK_CASTLE_LONG | BLACK_CASTLE_SHORT;
+   case SQUARE(7, 7): return BLACK_CASTLE_SHORT;
+   }
+
+   return 0;
+}
+
+void Position::RollBackOneMove()
+{
+   // there must be a move to roll back!
+   SCRITTY_ASSERT(*m_chain_length > 0);
+
+   const UndoRecord &undo = m_chain[--(*m_chain_length)];
+   const Move &move = undo.move;
+
+   // put the piece back (undoing any promotion)
+   RemovePiece(move.end_file, move.end_rank);
+   PlacePiece(move.start_file, move.start_rank, undo.moved_piece);
+
+   if (undo.captured_piece != NO_PIECE)
+      PlacePiece(undo.captured_file, undo.captured_rank, undo.captured_piece);
+
+   // put the rook back after a castle
+   if ((undo.moved_piece == 'K' || undo.moved_piece == 'k')
+      && move.start_file == 4)
+   {
+      if (move.end_file == 2)
       {
-         m_black_may_castle_short = false;
+         const char rook = m_squares[3][move.start_rank];
+         RemovePiece(3, move.start_rank);
+         PlacePiece(0, move.start_rank, rook);
       }
-      else if (move.start_file == 4)
+      else if (move.end_file == 6)
       {
-         // possibly move rook
-         if (piece == 'k')
-         {
-            if (move.end_file == 2)
-            {
-               m_squares[0][7] = NO_PIECE;
-               m_squares[3][7] = 'r';
-            }
-            else if (move.end_file == 6)
-            {
-               m_squares[7][7] = NO_PIECE;
-               m_squares[5][7] = 'r';
-            }
-
-            m_black_may_castle_long = false;
-            m_black_may_castle_short = false;
-         }
+         const char rook = m_squares[5][move.start_rank];
+         RemovePiece(5, move.start_rank);
+         PlacePiece(7, move.start_rank, rook);
       }
    }
 
-   // handle en passant rules
+   m_white_to_move = !m_white_to_move;
+   m_castle_rights = undo.castle_rights;
+   m_en_passant_allowed_on = undo.en_passant_allowed_on;
+   m_halfmove_clock = undo.halfmove_clock;
+   m_plies_from_null = undo.plies_from_null;
+   m_hash = undo.hash;
+   m_checkers = undo.checkers;
+}
+
+void Position::ApplyKnownLegalMove(const Move &move)
+{
+   // save what the move destroys (for roll back and various draw rules)
+
+   SCRITTY_ASSERT(*m_chain_length < MAX_POSITION_CHAIN_LEN);
+   UndoRecord &undo = m_chain[(*m_chain_length)++];
 
-   if (move.start_rank == 4 && piece == 'P'
-      && (move.end_file == move.start_file - 1
-      || move.end_file == move.start_file + 1)
-      && m_en_passant_allowed_on == move.end_file)
+   const char piece = m_squares[move.start_file][move.start_rank];
+   const bool pawn = piece == 'P' || piece == 'p';
+
+   undo.move = move;
+   undo.moved_piece = piece;
+   undo.captured_piece = m_squares[move.end_file][move.end_rank];
+   undo.captured_file = move.end_file;
+   undo.captured_rank = move.end_rank;
+   undo.castle_rights = m_castle_rights;
+   undo.en_passant_allowed_on = m_en_passant_allowed_on;
+   undo.halfmove_clock = m_halfmove_clock;
+   undo.plies_from_null = m_plies_from_null;
+   undo.hash = m_hash;
+   undo.checkers = m_checkers;
+
+   // a pawn moving diagonally to an empty square captures en passant
+   if (pawn && move.end_file != move.start_file
+      && undo.captured_piece == NO_PIECE)
    {
-      m_squares[move.end_file][4] = NO_PIECE;
+      undo.captured_rank = move.start_rank;
+      undo.captured_piece = m_squares[move.end_file][move.start_rank];
    }
-   else if (move.start_rank == 3 && piece == 'p'
-      && (move.end_file == move.start_file - 1
-      || move.end_file == move.start_file + 1)
-      && m_en_passant_allowed_on == move.end_file)
+
+   // move the piece
+
+   if (undo.captured_piece != NO_PIECE)
+      RemovePiece(undo.captured_file, undo.captured_rank);
+
+   RemovePiece(move.start_file, move.start_rank);
+
+   // handle promotion
+   if ((move.end_rank == 7 && piece == 'P')
+      || (move.end_rank == 0 && piece == 'p'))
    {
-      m_squares[move.end_file][3] = NO_PIECE;
+      // in some UCI output, promotion pieces are not cased as expected
+      PlacePiece(move.end_file, move.end_rank, m_white_to_move
+         ? ::toupper(move.promotion_piece) : ::tolower(move.promotion_piece));
+   }
+   else
+   {
+      PlacePiece(move.end_file, move.end_rank, piece);
    }
 
-   if (move.start_rank == 1 && move.end_rank == 3 && piece == 'P')
+   // possibly move rook
+   if ((piece == 'K' || piece == 'k') && move.start_file == 4)
    {
-      m_en_passant_allowed_on = move.start_file;
+      const char rook = piece == 'K' ? 'R' : 'r';
+
+      if (move.end_file == 2)
+      {
+         RemovePiece(0, move.start_rank);
+         PlacePiece(3, move.start_rank, rook);
+      }
+      else if (move.end_file == 6)
+      {
+         RemovePiece(7, move.start_rank);
+         PlacePiece(5, move.start_rank, rook);
+      }
    }
-   else if (move.start_rank == 6 && move.end_rank == 4 && piece == 'p')
+
+   // handle castle rules
+   m_hash ^= Zobrist::CastleKey(m_castle_rights);
+   m_castle_rights &= ~(CastleRightsLostOn(move.start_file, move.start_rank)
+      | CastleRightsLostOn(move.end_file, move.end_rank));
+   m_hash ^= Zobrist::CastleKey(m_castle_rights);
+
+   // handle en passant rules
+
+   if (m_en_passant_allowed_on != NO_EN_PASSANT)
+      m_hash ^= Zobrist::EnPassantKey(m_en_passant_allowed_on);
+
+   if (pawn && (move.end_rank == move.start_rank + 2
+      || move.start_rank == move.end_rank + 2))
    {
       m_en_passant_allowed_on = move.start_file;
+      m_hash ^= Zobrist::EnPassantKey(m_en_passant_allowed_on);
    }
    else
    {
       m_en_passant_allowed_on = NO_EN_PASSANT;
    }
 
-   // handle promotion
-   if ((move.end_rank == 7 && piece == 'P')
-      || (move.end_rank == 0 && piece == 'p'))
+   // captures and pawn moves cannot be reversed
+   if (pawn || undo.captured_piece != NO_PIECE)
+      m_halfmove_clock = 0;
+   else
+      ++m_halfmove_clock;
+   ++m_plies_from_null;
+
+   // switch sides
+   m_white_to_move = !m_white_to_move;
+   m_hash ^= Zobrist::BlackToMoveKey();
+   m_checkers = FindCheckers();
+}
+
+void Position::ApplyNullMove()
+{
+   SCRITTY_ASSERT(m_checkers == 0);
+   SCRITTY_ASSERT(*m_chain_length < MAX_POSITION_CHAIN_LEN);
+
+   // the record keeps the chain intact for the draw rules, but it does not
+   // describe a move, so only RollBackNullMove may take it back
+
+   UndoRecord &undo = m_chain[(*m_chain_length)++];
+   undo.move.start_file = undo.move.end_file = 0;
+   undo.move.start_rank = undo.move.end_rank = 0;
+   undo.move.promotion_piece = NO_PIECE;
+   undo.moved_piece = NO_PIECE;
+   undo.captured_piece = NO_PIECE;
+   undo.castle_rights = m_castle_rights;
+   undo.en_passant_allowed_on = m_en_passant_allowed_on;
+   undo.halfmove_clock = m_halfmove_clock;
+   undo.plies_from_null = m_plies_from_null;
+   undo.hash = m_hash;
+   undo.checkers = 0;
+
+   if (m_en_passant_allowed_on != NO_EN_PASSANT)
    {
-      // in some UCI output, promotion pieces are not cased as expected
-      m_squares[move.end_file][move.end_rank]
-      = m_white_to_move
-         ? ::toupper(move.promotion_piece) : ::tolower(move.promotion_piece);
+      m_hash ^= Zobrist::EnPassantKey(m_en_passant_allowed_on);
+      m_en_passant_allowed_on = NO_EN_PASSANT;
    }
 
-   // switch sides
+   // passing is not a move in the game, so it neither adds to the fifty-move
+   // count nor lets a later position repeat one from before it
+   m_plies_from_null = 0;
+
+   // the side that passed was not in check, so it gives no check either
    m_white_to_move = !m_white_to_move;
+   m_hash ^= Zobrist::BlackToMoveKey();
+   m_checkers = 0;
+}
+
+void Position::RollBackNullMove()
+{
+   SCRITTY_ASSERT(*m_chain_length > 0);
+
+   const UndoRecord &undo = m_chain[--(*m_chain_length)];
+   SCRITTY_ASSERT(undo.moved_piece == NO_PIECE);
+
+   m_white_to_move = !m_white_to_move;
+   m_en_passant_allowed_on = undo.en_passant_allowed_on;
+   m_halfmove_clock = undo.halfmove_clock;
+   m_plies_from_null = undo.plies_from_null;
+   m_hash = undo.hash;
+   m_checkers = undo.checkers;
+}
+
+bool Position::GetLastMove(Move *move) const
+{
+   if (*m_chain_length == 0)
+      return false;
+
+   const UndoRecord &undo = m_chain[*m_chain_length - 1];
+   if (undo.moved_piece == NO_PIECE)
+      return false; // a null move
+
+   *move = undo.move;
+   return true;
+}
+
+void Position::PlacePiece(unsigned char file, unsigned char rank, char piece)
+{
+   // square must be empty
+   SCRITTY_ASSERT(m_squares[file][rank] == NO_PIECE);
+
+   const unsigned char square = SQUARE(file, rank);
+   const int piece_index = GetPieceIndex(piece);
+   m_pieces[piece_index] |= SquareMask(square);
+   m_side_pieces[piece < 'Z' ? WHITE : BLACK] |= SquareMask(square);
+   m_squares[file][rank] = piece;
+   m_hash ^= Zobrist::PieceKey(piece_index, square);
+}
+
+void Position::RemovePiece(unsigned char file, unsigned char rank)
+{
+   // okay to call on an empty square
+
+   const char piece = m_squares[file][rank];
+
+   if (piece == NO_PIECE)
+      return;
+
+   const unsigned char square = SQUARE(file, rank);
+   const int piece_index = GetPieceIndex(piece);
+   m_pieces[piece_index] &= ~SquareMask(square);
+   m_side_pieces[piece < 'Z' ? WHITE : BLACK] &= ~SquareMask(square);
+   m_squares[file][rank] = NO_PIECE;
+   m_hash ^= Zobrist::PieceKey(piece_index, square);
+}
 
-   // reset hash
-   m_hash = POSITION_HASH_MODULUS;
+void Position::SynchronizeBitboards()
+{
+   memset(m_pieces, 0, sizeof(m_pieces));
+   memset(m_side_pieces, 0, sizeof(m_side_pieces));
+
+   for (unsigned char file = 0; file <= 7; ++file)
+   {
+      for (unsigned char rank = 0; rank <= 7; ++rank)
+      {
+         const char piece = m_squares[file][rank];
+         const int piece_index = GetPieceIndex(piece);
+
+         if (piece_index == PIECE_INDEX_COUNT)
+            continue; // empty (or not a real piece)
+
+         const Bitboard mask = SquareMask(SQUARE(file, rank));
+         m_pieces[piece_index] |= mask;
+         m_side_pieces[piece < 'Z' ? WHITE : BLACK] |= mask;
+      }
+   }
 }
 
 bool Position::IsRookMoveLegal(const Move &move) const
@@ -276,10 +553,7 @@ bool Position::operator==(const Position &other) const
    // used to compare for threefold repetition and for position table lookup
 
    if (m_white_to_move != other.m_white_to_move
-      || m_white_may_castle_short != other.m_white_may_castle_short
-      || m_white_may_castle_long != other.m_white_may_castle_long
-      || m_black_may_castle_short != other.m_black_may_castle_short
-      || m_black_may_castle_long != other.m_black_may_castle_long
+      || m_castle_rights != other.m_castle_rights
       || m_en_passant_allowed_on != other.m_en_passant_allowed_on)
       return false;
 
@@ -306,10 +580,20 @@ bool Position::MayClaimDraw() const
    // move in which the repetition occurs, the player forfeits the right to make
    // the claim. Of course, the opportunity may present itself again.
 
+   // look back through the moves since the last capture or pawn move (no
+   // position before one of those can be identical to this one), comparing
+   // only positions with the same player to move, and never past a null move
+   // of the search (a position before it is not one from the game)
+
+   size_t reversible_moves = m_halfmove_clock < *m_chain_length
+      ? m_halfmove_clock : *m_chain_length;
+   if (m_plies_from_null < reversible_moves)
+      reversible_moves = m_plies_from_null;
+
    size_t identical_count = 0;
-   for (size_t i = 0; i < *m_chain_length; ++i)
+   for (size_t i = 2; i <= reversible_moves; i += 2)
    {
-      if (*this == m_chain[i])
+      if (m_chain[*m_chain_length - i].hash == m_hash)
       {
          if (identical_count == 1)
             return true; // either side may claim a draw
@@ -326,7 +610,13 @@ bool Position::MayClaimDraw() const
    // draw is forfeited if it is not used on that move, but the opportunity may
    // occur again.
 
-   // TODO P2
+   // fifty moves by each side are a hundred plies, and a checkmate on the
+   // last of them still wins (the clock only grows, so this is rare enough
+   // that counting the legal moves costs nothing overall)
+
+   if (m_halfmove_clock >= FIFTY_MOVE_RULE_PLIES
+      && (!IsCheck(m_white_to_move) || ListAllLegalMoves() > 0))
+      return true;
 
    // Impossibility of checkmate - if a position arises in which neither player
    // could possibly give checkmate by a series of legal moves, the game is a
@@ -340,710 +630,107 @@ bool Position::MayClaimDraw() const
    //     colour. (Any number of additional bishops of either color on the same
    //     color of square due to underpromotion do not affect the situation.)
 
-   // TODO P2 should not go in "May Claim Draw" but should be in "Is A Draw"
+   // that is not a claim but the end of the game, so it is left to
+   // IsInsufficientMaterial
 
    return false;
 }
 
-bool Position::IsKnightMoveLegal(const Move &move) const
+bool Position::IsInsufficientMaterial() const
 {
-   // check that it is a valid motion
-
-   if ((move.end_rank == move.start_rank + 2
-      && move.end_file == move.start_file - 1)
-
-      || (move.end_rank == move.start_rank + 2
-      && move.end_file == move.start_file + 1)
-
-      || (move.end_rank == move.start_rank + 1
-      && move.end_file == move.start_file + 2)
-
-      || (move.end_rank == move.start_rank - 1
-      && move.end_file == move.start_file + 2)
-
-      || (move.end_rank == move.start_rank - 2
-      && move.end_file == move.start_file + 1)
-
-      || (move.end_rank == move.start_rank - 2
-      && move.end_file == move.start_file - 1)
-
-      || (move.end_rank == move.start_rank - 1
-      && move.end_file == move.start_file - 2)
-
-      || (move.end_rank == move.start_rank + 1
-      && move.end_file == move.start_file - 2))
-   {
-      // check that it is a valid empty square or capture
-      return m_squares[move.end_file][move.end_rank]
-      == NO_PIECE || IsOpponentsPiece(
-         m_squares[move.start_file][move.start_rank],
-         m_squares[move.end_file][move.end_rank]);
-   }
-
-   return false;
-}
-
-inline bool IsKnightAttacking(bool white, unsigned char file, unsigned char rank,
-   const char squares[8][8])
-{
-   if (file < 8 && rank < 8) // unsigned char never negative
-   {
-      char piece = squares[file][rank];
-
-      if (white)
-      {
-         if (piece == 'N')
-            return true;
-      }
-      else // black
-      {
-         if (piece == 'n')
-            return true;
-      }
-   }
-
-   return false;
-}
-
-bool Position::IsAttackingSquare(
-   bool white, unsigned char file, unsigned char rank) const
-{
-   unsigned char search_file, search_rank;
-   bool king;
-
-   // check for attacking pawns
-
-   if (white)
-   {
-      if (rank > 1)
-      {
-         if (file > 0 && m_squares[file - 1][rank - 1] == 'P')
-            return true;
-         if (file < 7 && m_squares[file + 1][rank - 1] == 'P')
-            return true;
-      }
-   }
-   else // black
-   {
-      if (rank < 6)
-      {
-         if (file > 0 && m_squares[file - 1][rank + 1] == 'p')
-            return true;
-         if (file < 7 && m_squares[file + 1][rank + 1] == 'p')
-            return true;
-      }
-   }
-
-   // check for bishops or queens to the "southwest"
-
-   search_file = file - 1;
-   search_rank = rank - 1;
-   king = true;
-
-   while (search_file < 8 && search_rank < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'B' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'b' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
-
-         break; // interposing piece
-      }
-
-      --search_file;
-      --search_rank;
-      king = false;
-   }
-
-   // check for bishops or queens to the "southeast"
-
-   search_file = file + 1;
-   search_rank = rank - 1;
-   king = true;
-
-   while (search_file < 8 && search_rank < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'B' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'b' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
-
-         break; // interposing piece
-      }
-
-      ++search_file;
-      --search_rank;
-      king = false;
-   }
-
-   // check for bishops or queens to the "northwest"
-
-   search_file = file - 1;
-   search_rank = rank + 1;
-   king = true;
-
-   while (search_file < 8 && search_rank < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'B' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'b' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
-
-         break; // interposing piece
-      }
-
-      --search_file;
-      ++search_rank;
-      king = false;
-   }
-
-   // check for bishops or queens to the "northeast"
-
-   search_file = file + 1;
-   search_rank = rank + 1;
-   king = true;
-
-   while (search_file < 8 && search_rank < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'B' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'b' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
-
-         break; // interposing piece
-      }
-
-      ++search_file;
-      ++search_rank;
-      king = false;
-   }
-
-   // check for rooks or queens to the "south"
-
-   search_file = file;
-   search_rank = rank - 1;
-   king = true;
-
-   while (search_rank < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'R' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'r' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
+   // a pawn, rook or queen can always mate with help
 
-         break; // interposing piece
-      }
-
-      --search_rank;
-      king = false;
-   }
-
-   // check for rooks or queens to the "north"
-
-   search_file = file;
-   search_rank = rank + 1;
-   king = true;
-
-   while (search_rank < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'R' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'r' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
-
-         break; // interposing piece
-      }
-
-      ++search_rank;
-      king = false;
-   }
-
-   // check for rooks or queens to the "east"
-
-   search_file = file + 1;
-   search_rank = rank;
-   king = true;
-
-   while (search_file < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'R' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'r' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
-
-         break; // interposing piece
-      }
-
-      ++search_file;
-      king = false;
-   }
-
-   // check for rooks or queens to the "west"
-
-   search_file = file - 1;
-   search_rank = rank;
-   king = true;
-
-   while (search_file < 8) // unsigned char never negative
-   {
-      char piece = m_squares[search_file][search_rank];
-
-      if (piece != NO_PIECE)
-      {
-         if (white)
-         {
-            if (piece == 'R' || piece == 'Q' || (king && piece == 'K') )
-               return true;
-         }
-         else // black
-         {
-            if (piece == 'r' || piece == 'q' || (king && piece == 'k') )
-               return true;
-         }
-
-         break; // interposing piece
-      }
-
-      --search_file;
-      king = false;
-   }
-
-   // check for knights
-
-   if (IsKnightAttacking(white, file - 2, rank + 1, m_squares))
-      return true;
-
-   if (IsKnightAttacking(white, file - 1, rank + 2, m_squares))
-      return true;
-
-   if (IsKnightAttacking(white, file + 1, rank + 2, m_squares))
-      return true;
-
-   if (IsKnightAttacking(white, file + 2, rank + 1, m_squares))
-      return true;
-
-   if (IsKnightAttacking(white, file + 2, rank - 1, m_squares))
-      return true;
-
-   if (IsKnightAttacking(white, file + 1, rank - 2, m_squares))
-      return true;
+   const Bitboard heavy = m_pieces[WHITE_PAWN] | m_pieces[BLACK_PAWN]
+      | m_pieces[WHITE_ROOK] | m_pieces[BLACK_ROOK]
+      | m_pieces[WHITE_QUEEN] | m_pieces[BLACK_QUEEN];
+   if (heavy != 0)
+      return false;
 
-   if (IsKnightAttacking(white, file - 1, rank - 2, m_squares))
-      return true;
+   const Bitboard knights = m_pieces[WHITE_KNIGHT] | m_pieces[BLACK_KNIGHT];
+   const Bitboard bishops = m_pieces[WHITE_BISHOP] | m_pieces[BLACK_BISHOP];
 
-   if (IsKnightAttacking(white, file - 2, rank - 1, m_squares))
+   // king versus king, or with a single minor piece
+   if (CountSquares(knights | bishops) <= 1)
       return true;
 
-   return false;
-}
-
-size_t Position::PopulateQueenEndpoints(unsigned char start_file,
-   unsigned char start_rank, unsigned char *endpoints) const
-{
-   size_t endpoints_index = PopulateBishopEndpoints(
-      start_file, start_rank, endpoints);
-   endpoints_index += PopulateRookEndpoints(
-      start_file, start_rank, endpoints + endpoints_index);
-   return endpoints_index;
-}
-
-size_t Position::PopulateKingEndpoints(unsigned char start_file,
-   unsigned char start_rank, unsigned char *endpoints) const
-{
-   // DOES NOT THINK ABOUT CASTLE
-
-   size_t endpoints_index = 0;
-
-   for (char i = -1; i <= 1; ++i)
-      for (char j = -1; j <= 1; ++j)
-      {
-         if (i == 0 && j == 0)
-            continue;
-
-         unsigned char file = start_file + i;
-         if (file > 7)
-            continue;
-
-         unsigned char rank = start_rank + j;
-         if (rank > 7)
-            continue;
-
-         endpoints[endpoints_index++] = file;
-         endpoints[endpoints_index++] = rank;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-
-   return endpoints_index;
-}
-
-size_t Position::PopulateBishopEndpoints(unsigned char start_file,
-   unsigned char start_rank, unsigned char *endpoints) const
-{
-   size_t endpoints_index = 0;
-
-   char file = start_file + 1;
-   char rank = start_rank + 1;
-
-   char start_piece = m_squares[start_file][start_rank];
-
-   while (file <= 7 && rank <= 7)
-   {
-      if (m_squares[file][rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = file++;
-         endpoints[endpoints_index++] = rank++;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[file][rank]))
-         {
-            endpoints[endpoints_index++] = file++;
-            endpoints[endpoints_index++] = rank++;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   file = start_file + 1;
-   rank = start_rank - 1;
-
-   while (file <= 7 && rank >= 0)
-   {
-      if (m_squares[file][rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = file++;
-         endpoints[endpoints_index++] = rank--;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[file][rank]))
-         {
-            endpoints[endpoints_index++] = file++;
-            endpoints[endpoints_index++] = rank--;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   file = start_file - 1;
-   rank = start_rank - 1;
-
-   while (file >= 0 && rank >= 0)
-   {
-      if (m_squares[file][rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = file--;
-         endpoints[endpoints_index++] = rank--;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[file][rank]))
-         {
-            endpoints[endpoints_index++] = file--;
-            endpoints[endpoints_index++] = rank--;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   file = start_file - 1;
-   rank = start_rank + 1;
-
-   while (file >= 0 && rank <= 7)
-   {
-      if (m_squares[file][rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = file--;
-         endpoints[endpoints_index++] = rank++;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[file][rank]))
-         {
-            endpoints[endpoints_index++] = file--;
-            endpoints[endpoints_index++] = rank++;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   return endpoints_index;
+   // only bishops, all on the same color of square
+   return knights == 0 && ((bishops & LIGHT_SQUARES_MASK) == 0
+      || (bishops & ~LIGHT_SQUARES_MASK) == 0);
 }
 
-size_t Position::PopulateRookEndpoints(unsigned char start_file,
-   unsigned char start_rank, unsigned char *endpoints) const
-{
-   size_t endpoints_index = 0;
-
-   char start_piece = m_squares[start_file][start_rank];
-
-   for (char rank = start_rank + 1; rank <= 7; ++rank)
-   {
-      if (m_squares[start_file][rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = start_file;
-         endpoints[endpoints_index++] = rank;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[start_file][rank]))
-         {
-            endpoints[endpoints_index++] = start_file;
-            endpoints[endpoints_index++] = rank;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   for (char rank = start_rank - 1; rank >= 0; --rank)
-   {
-      if (m_squares[start_file][rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = start_file;
-         endpoints[endpoints_index++] = rank;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[start_file][rank]))
-         {
-            endpoints[endpoints_index++] = start_file;
-            endpoints[endpoints_index++] = rank;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   for (char file = start_file + 1; file <= 7; ++file)
-   {
-      if (m_squares[file][start_rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = file;
-         endpoints[endpoints_index++] = start_rank;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[file][start_rank]))
-         {
-            endpoints[endpoints_index++] = file;
-            endpoints[endpoints_index++] = start_rank;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   for (char file = start_file - 1; file >= 0; --file)
-   {
-      if (m_squares[file][start_rank] == NO_PIECE)
-      {
-         endpoints[endpoints_index++] = file;
-         endpoints[endpoints_index++] = start_rank;
-         endpoints[endpoints_index++] = NO_PIECE;
-      }
-      else
-      {
-         if (IsOpponentsPiece(start_piece, m_squares[file][start_rank]))
-         {
-            endpoints[endpoints_index++] = file;
-            endpoints[endpoints_index++] = start_rank;
-            endpoints[endpoints_index++] = NO_PIECE;
-         }
-
-         break;
-      }
-   }
-
-   return endpoints_index;
-}
-
-size_t Position::PopulateKnightEndpoints(unsigned char start_file,
-   unsigned char start_rank, unsigned char *endpoints) const
+bool Position::IsKnightMoveLegal(const Move &move) const
 {
-   // okay for some endpoints to be off board
+   // check that it is a valid motion
 
-   size_t endpoints_index = 0;
+   if ((move.end_rank == move.start_rank + 2
+      && move.end_file == move.start_file - 1)
 
-   char start_piece = m_squares[start_file][start_rank];
+      || (move.end_rank == move.start_rank + 2
+      && move.end_file == move.start_file + 1)
 
-   unsigned char file = start_file + 1;
-   unsigned char rank = start_rank + 2;
+      || (move.end_rank == move.start_rank + 1
+      && move.end_file == move.start_file + 2)
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
-   {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
-   }
+      || (move.end_rank == move.start_rank - 1
+      && move.end_file == move.start_file + 2)
 
-   file = start_file + 2;
-   rank = start_rank + 1;
+      || (move.end_rank == move.start_rank - 2
+      && move.end_file == move.start_file + 1)
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
-   {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
-   }
+      || (move.end_rank == move.start_rank - 2
+      && move.end_file == move.start_file - 1)
 
-   file = start_file + 2;
-   rank = start_rank - 1;
+      || (move.end_rank == move.start_rank - 1
+      && move.end_file == move.start_file - 2)
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
+      || (move.end_rank == move.start_rank + 1
+      && move.end_file == move.start_file - 2))
    {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
+      // check that it is a valid empty square or capture
+      return m_squares[move.end_file][move.end_rank]
+      == NO_PIECE || IsOpponentsPiece(
+         m_squares[move.start_file][move.start_rank],
+         m_squares[move.end_file][move.end_rank]);
    }
 
-   file = start_file + 1;
-   rank = start_rank - 2;
+   return false;
+}
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
-   {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
-   }
+bool Position::IsAttackingSquare(
+   bool white, unsigned char file, unsigned char rank) const
+{
+   return IsAttackingSquare(white, SQUARE(file, rank));
+}
 
-   file = start_file - 1;
-   rank = start_rank - 2;
+bool Position::IsAttackingSquare(bool white, unsigned char square) const
+{
+   const Side side = white ? WHITE : BLACK;
+   const Bitboard occupied = GetOccupied();
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
-   {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
-   }
+   // a pawn attacks the square if a pawn of the other color standing on the
+   // square would attack the pawn
 
-   file = start_file - 2;
-   rank = start_rank - 1;
+   if (Bitboards::PawnAttacks(white ? BLACK : WHITE, square)
+      & m_pieces[GetPieceIndex(side, PAWN)])
+      return true;
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
-   {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
-   }
+   if (Bitboards::KnightAttacks(square) & m_pieces[GetPieceIndex(side, KNIGHT)])
+      return true;
 
-   file = start_file - 2;
-   rank = start_rank + 1;
+   if (Bitboards::KingAttacks(square) & m_pieces[GetPieceIndex(side, KING)])
+      return true;
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
-   {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
-   }
+   const Bitboard queens = m_pieces[GetPieceIndex(side, QUEEN)];
 
-   file = start_file - 1;
-   rank = start_rank + 2;
+   if (Bitboards::BishopAttacks(square, occupied)
+      & (m_pieces[GetPieceIndex(side, BISHOP)] | queens))
+      return true;
 
-   if (file <= 7 && rank <= 7 && (m_squares[file][rank] == NO_PIECE
-      || IsOpponentsPiece(start_piece, m_squares[file][rank])))
-   {
-      endpoints[endpoints_index++] = file;
-      endpoints[endpoints_index++] = rank;
-      endpoints[endpoints_index++] = NO_PIECE;
-   }
+   if (Bitboards::RookAttacks(square, occupied)
+      & (m_pieces[GetPieceIndex(side, ROOK)] | queens))
+      return true;
 
-   return endpoints_index;
+   return false;
 }
 
 bool Position::IsMoveLegal(const Move &move) const
@@ -1198,7 +885,7 @@ bool Position::IsMoveLegal(
       if (move.start_file == 4 && move.start_rank == 0
          && move.end_file == 6 && move.end_rank == 0) // castle short
       {
-         if (!m_white_may_castle_short)
+         if (!(m_castle_rights & WHITE_CASTLE_SHORT))
             return false;
 
          // check that there are no pieces at f1 or g1
@@ -1219,7 +906,7 @@ bool Position::IsMoveLegal(
       else if (move.start_file == 4 && move.start_rank == 0
          && move.end_file == 2 && move.end_rank == 0) // castle long
       {
-         if (!m_white_may_castle_long)
+         if (!(m_castle_rights & WHITE_CASTLE_LONG))
             return false;
 
          // check that there are no pieces at b1, c1 or d1
@@ -1258,7 +945,7 @@ bool Position::IsMoveLegal(
       if (move.start_file == 4 && move.start_rank == 7
          && move.end_file == 6 && move.end_rank == 7) // castle short
       {
-         if (!m_black_may_castle_short)
+         if (!(m_castle_rights & BLACK_CASTLE_SHORT))
             return false;
 
          // check that there are no pieces at f8 or g8
@@ -1280,7 +967,7 @@ bool Position::IsMoveLegal(
       else if (move.start_file == 4 && move.start_rank == 7
          && move.end_file == 2 && move.end_rank == 7) // castle long
       {
-         if (!m_black_may_castle_long)
+         if (!(m_castle_rights & BLACK_CASTLE_LONG))
             return false;
 
          // check that there are no pieces at b8, c8 or d8
@@ -1321,365 +1008,480 @@ bool Position::IsMoveLegal(
 
    // is my king in check after the move?
 
-   if (check_king)
-   {
-      Position& must_roll_back = const_cast<Position&>(*this);
-      must_roll_back.ApplyKnownLegalMove(move);
-      must_roll_back.m_white_to_move = !must_roll_back.m_white_to_move;
-      bool is_check = must_roll_back.IsCheck(m_white_to_move);
-      must_roll_back.RollBackOneMove();
-      if (is_check)
-         return false;
-   }
+   if (check_king && LeavesKingInCheck(move))
+      return false;
 
    return true;
 }
 
+bool Position::LeavesKingInCheck(const Move &move) const
+{
+   const bool white = m_white_to_move;
+
+   Position& must_roll_back = const_cast<Position&>(*this);
+   must_roll_back.ApplyKnownLegalMove(move);
+   bool is_check = must_roll_back.IsCheck(white);
+   must_roll_back.RollBackOneMove();
+
+   return is_check;
+}
+
 bool Position::IsCheck(bool white) const
 {
-   char which_king = white ? 'K' : 'k';
+   if (white == m_white_to_move)
+      return m_checkers != 0;
+
+   const Bitboard king = m_pieces[white ? WHITE_KING : BLACK_KING];
+
+   if (king == 0)
+      return false; // should never get here if king is on board
+
+   return IsAttackingSquare(!white, LowestSquare(king));
+}
+
+Bitboard Position::FindCheckers() const
+{
+   const Side side = m_white_to_move ? WHITE : BLACK;
+   const Bitboard king = m_pieces[GetPieceIndex(side, KING)];
+
+   if (king == 0)
+      return 0; // should never get here if king is on board
+
+   return GetAttackers(side == WHITE ? BLACK : WHITE, LowestSquare(king),
+      GetOccupied());
+}
+
+/*static*/ size_t Position::s_table_hits = 0;
+/*static*/ size_t Position::s_table_misses = 0;
+
+static inline void SetMove(Move *move,
+   unsigned char from, unsigned char to, char promotion_piece)
+{
+   move->start_file = SQUARE_FILE(from);
+   move->start_rank = SQUARE_RANK(from);
+   move->end_file = SQUARE_FILE(to);
+   move->end_rank = SQUARE_RANK(to);
+   move->promotion_piece = promotion_piece;
+}
+
+static size_t AddMoves(
+   unsigned char from, Bitboard targets, Move *buf, size_t count)
+{
+   while (targets != 0)
+   {
+      SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
+      SetMove(buf + count++, from, PopLowestSquare(&targets), NO_PIECE);
+   }
+
+   return count;
+}
+
+static size_t AddPawnMoves(Bitboard targets, int offset, bool white,
+   Move *buf, size_t count)
+{
+   // offset is the distance from the start square to the end square
+
+   static const char *white_promotions = "QRBN";
+   static const char *black_promotions = "qrbn";
 
-   for (unsigned char rank = 0; rank <= 7; ++rank)
+   while (targets != 0)
    {
-      for (unsigned char file = 0; file <= 7; ++file)
+      const unsigned char to = PopLowestSquare(&targets);
+      const unsigned char from = (unsigned char)(to - offset);
+
+      if (SQUARE_RANK(to) == 7 || SQUARE_RANK(to) == 0)
+      {
+         const char *promotions = white ? white_promotions : black_promotions;
+
+         for (size_t i = 0; i < 4; ++i)
+         {
+            SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
+            SetMove(buf + count++, from, to, promotions[i]);
+         }
+      }
+      else
       {
-         if (m_squares[file][rank] == which_king)
-            return IsAttackingSquare(!white, file, rank);
+         SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
+         SetMove(buf + count++, from, to, NO_PIECE);
       }
    }
 
-   return false; // should never get here if king is on board
+   return count;
 }
 
-/*static*/ size_t Position::s_table_hits = 0;
-/*static*/ size_t Position::s_table_misses = 0;
+// knights and bishops are taken to be worth the same, and a king is worth
+// more than everything else together, so it never loses an exchange
+/*static*/ const int Position::s_exchange_values[PIECE_TYPE_COUNT]
+   = { 100, 300, 300, 500, 900, 10000 };
 
-size_t Position::ListAllLegalMoves(Move *buf /*= nullptr*/) const
+int Position::EvaluateExchange(const Move &move) const
 {
-   // pass in null buffer to test if there are any legal moves
-   // (returns 0 if no legal moves)
+   const unsigned char from = SQUARE(move.start_file, move.start_rank);
+   const unsigned char to = SQUARE(move.end_file, move.end_rank);
+   const char piece = m_squares[move.start_file][move.start_rank];
+   const char captured = m_squares[move.end_file][move.end_rank];
+   PieceType type = (PieceType)(GetPieceIndex(piece) % PIECE_TYPE_COUNT);
 
-   size_t count = 0;
+   Bitboard occupied = GetOccupied() & ~SquareMask(from);
+
+   // gain[i] is what the side making capture i wins if the exchange ends
+   // there
 
-   // first check the position table
-   SCRITTY_ASSERT(m_position_table != nullptr);
-   if (m_position_table->Lookup(*this, buf, &count))
+   int gain[32];
+   gain[0] = 0;
+
+   if (captured != NO_PIECE)
    {
-      SCRITTY_ASSERT(++s_table_hits > 0);
-      return count;
+      gain[0] = s_exchange_values[GetPieceIndex(captured) % PIECE_TYPE_COUNT];
+   }
+   else if (type == PAWN && move.start_file != move.end_file)
+   {
+      gain[0] = s_exchange_values[PAWN]; // en passant
+      occupied &= ~SquareMask(SQUARE(move.end_file, move.start_rank));
    }
 
-   SCRITTY_ASSERT(++s_table_misses > 0);
+   if (move.promotion_piece != NO_PIECE)
+   {
+      type = (PieceType)(GetPieceIndex((char)::toupper(move.promotion_piece))
+         % PIECE_TYPE_COUNT);
+      gain[0] += s_exchange_values[type] - s_exchange_values[PAWN];
+   }
+
+   // the pieces removed from occupied uncover those behind them, so the
+   // attackers are found again after every capture
+
+   Side side = m_white_to_move ? BLACK : WHITE;
+   size_t depth = 0;
+
+   for (;;)
+   {
+      const Bitboard attackers = GetAttackers(side, to, occupied) & occupied;
+      if (attackers == 0)
+         break;
+
+      PieceType attacker = PAWN;
+      while ((attackers & m_pieces[GetPieceIndex(side, attacker)]) == 0)
+         attacker = (PieceType)(attacker + 1);
+
+      // the king may only capture the last piece
+      if (attacker == KING && (GetAttackers(side == WHITE ? BLACK : WHITE,
+         to, occupied) & occupied) != 0)
+         break;
+
+      SCRITTY_ASSERT(depth + 1 < sizeof(gain)/sizeof(gain[0]));
+      ++depth;
+      gain[depth] = s_exchange_values[type] - gain[depth - 1];
+
+      occupied &= ~SquareMask(LowestSquare(
+         attackers & m_pieces[GetPieceIndex(side, attacker)]));
+      type = attacker;
+      side = side == WHITE ? BLACK : WHITE;
+   }
+
+   // each side stops capturing when going on would lose it more
+   while (depth > 0)
+   {
+      --depth;
+      if (gain[depth + 1] > -gain[depth])
+         gain[depth] = -gain[depth + 1];
+   }
+
+   return gain[0];
+}
+
+Bitboard Position::GetAttackers(
+   Side side, unsigned char square, Bitboard occupied) const
+{
+   // a pawn attacks the square if a pawn of the other color standing on the
+   // square would attack the pawn
+
+   const Bitboard queens = m_pieces[GetPieceIndex(side, QUEEN)];
+
+   return (Bitboards::PawnAttacks(side == WHITE ? BLACK : WHITE, square)
+      & m_pieces[GetPieceIndex(side, PAWN)])
+      | (Bitboards::KnightAttacks(square)
+      & m_pieces[GetPieceIndex(side, KNIGHT)])
+      | (Bitboards::KingAttacks(square) & m_pieces[GetPieceIndex(side, KING)])
+      | (Bitboards::BishopAttacks(square, occupied)
+      & (m_pieces[GetPieceIndex(side, BISHOP)] | queens))
+      | (Bitboards::RookAttacks(square, occupied)
+      & (m_pieces[GetPieceIndex(side, ROOK)] | queens));
+}
+
+size_t Position::ListPawnMoves(Bitboard pawns, Bitboard allowed,
+   bool captures, bool quiet_moves, Move *buf, size_t count) const
+{
+   // allowed limits the end squares, except for en passant
+
+   const bool white = m_white_to_move;
+   const Bitboard enemy = m_side_pieces[white ? BLACK : WHITE];
+   const Bitboard empty = ~GetOccupied();
+
+   const Bitboard promotion_rank = white ? RANK_8_MASK : RANK_1_MASK;
+   const Bitboard push_targets = allowed & ((captures ? promotion_rank : 0)
+      | (quiet_moves ? ~promotion_rank : 0));
+   const Bitboard capture_targets = allowed & (captures ? enemy : 0);
+
+   if (white)
+   {
+      const Bitboard pushes = (pawns << 8) & empty;
+      count = AddPawnMoves(pushes & push_targets, 8, true, buf, count);
+      if (quiet_moves)
+         count = AddPawnMoves(((pushes & RANK_3_MASK) << 8) & empty & allowed,
+            16, true, buf, count);
+      count = AddPawnMoves(((pawns & ~FILE_A_MASK) << 7) & capture_targets,
+         7, true, buf, count);
+      count = AddPawnMoves(((pawns & ~FILE_H_MASK) << 9) & capture_targets,
+         9, true, buf, count);
+   }
+   else
+   {
+      const Bitboard pushes = (pawns >> 8) & empty;
+      count = AddPawnMoves(pushes & push_targets, -8, false, buf, count);
+      if (quiet_moves)
+         count = AddPawnMoves(((pushes & RANK_6_MASK) >> 8) & empty & allowed,
+            -16, false, buf, count);
+      count = AddPawnMoves(((pawns & ~FILE_A_MASK) >> 9) & capture_targets,
+         -9, false, buf, count);
+      count = AddPawnMoves(((pawns & ~FILE_H_MASK) >> 7) & capture_targets,
+         -7, false, buf, count);
+   }
+
+   return count;
+}
+
+size_t Position::ListLegalMoves(
+   Move *buf, bool captures /*= true*/, bool quiet_moves /*= true*/) const
+{
+   // the pieces giving check and the pieces pinned to the king are found
+   // once, so that moves are generated legal instead of being made to see if
+   // they leave the king in check
+   // captures and quiet moves can be listed separately, in which case a
+   // push to promote counts as a capture
+
+   const bool white = m_white_to_move;
+   const Side side = white ? WHITE : BLACK;
+   const Side enemy_side = white ? BLACK : WHITE;
+   const Bitboard own = m_side_pieces[side];
+   const Bitboard enemy = m_side_pieces[enemy_side];
+   const Bitboard occupied = own | enemy;
+   const Bitboard empty = ~occupied;
+   const Bitboard targets = (captures ? enemy : 0) | (quiet_moves ? empty : 0);
+
+   const Bitboard king_mask = m_pieces[GetPieceIndex(side, KING)];
+   if (king_mask == 0)
+      return 0; // should never get here if king is on board
+
+   const unsigned char king = LowestSquare(king_mask);
+
+   // when in check, other pieces may only capture the checker or block it
+   // (and in double check, only the king may move)
+
+   const Bitboard checkers = m_checkers;
+   Bitboard check_mask = ~0ull;
+
+   if (checkers != 0)
+   {
+      check_mask = (checkers & (checkers - 1)) != 0
+         ? 0 : checkers | Bitboards::Between(king, LowestSquare(checkers));
+   }
+
+   // a piece alone between the king and an enemy slider is pinned, so it may
+   // only move along the line of the pin
+
+   const Bitboard enemy_queens = m_pieces[GetPieceIndex(enemy_side, QUEEN)];
+   Bitboard snipers = (Bitboards::RookAttacks(king, 0)
+      & (m_pieces[GetPieceIndex(enemy_side, ROOK)] | enemy_queens))
+      | (Bitboards::BishopAttacks(king, 0)
+      & (m_pieces[GetPieceIndex(enemy_side, BISHOP)] | enemy_queens));
+   Bitboard pinned = 0;
+
+   while (snipers != 0)
+   {
+      const Bitboard between
+         = Bitboards::Between(king, PopLowestSquare(&snipers)) & occupied;
+      if (between != 0 && (between & (between - 1)) == 0)
+         pinned |= between & own;
+   }
+
+   size_t count = 0;
 
-   const size_t MAGIC_NUM = 100;
-   unsigned char endpoints[8*8*4 + 1]; // f1, r1, promotion1, f2, ..., MAGIC_NUM
-   Move move;
+   // pawns
 
-   for (move.start_file = 0; move.start_file <= 7; ++move.start_file)
+   const Bitboard pawns = m_pieces[GetPieceIndex(side, PAWN)];
+
+   if (check_mask != 0)
    {
-      for (move.start_rank = 0; move.start_rank <= 7; ++move.start_rank)
+      count = ListPawnMoves(pawns & ~pinned, check_mask, captures,
+         quiet_moves, buf, count);
+
+      Bitboard pinned_pawns = pawns & pinned;
+      while (pinned_pawns != 0)
       {
-         size_t endpoints_index = 0;
+         const unsigned char from = PopLowestSquare(&pinned_pawns);
+         count = ListPawnMoves(SquareMask(from),
+            check_mask & Bitboards::Line(king, from), captures, quiet_moves,
+            buf, count);
+      }
+   }
 
-         char piece = m_squares[move.start_file][move.start_rank];
+   if (captures && m_en_passant_allowed_on != NO_EN_PASSANT)
+   {
+      const unsigned char target
+         = SQUARE(m_en_passant_allowed_on, white ? 5 : 2);
 
-         if ((piece == NO_PIECE) || (piece > 'a' && m_white_to_move)
-            || (piece < 'Z' && !m_white_to_move))
-            continue;
+      // pawns that could capture on the target square
+      Bitboard attackers
+         = Bitboards::PawnAttacks(white ? BLACK : WHITE, target) & pawns;
 
-         switch (piece)
-         {
+      // two pawns leave the rank at once, so en passant is rare and odd
+      // enough to be tried on the board
+      while (attackers != 0)
+      {
+         Move *move = buf + count;
+         SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
+         SetMove(move, PopLowestSquare(&attackers), target, NO_PIECE);
 
-         case 'P':
-
-            if (move.start_rank < 6)
-            {
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank + 1;
-               endpoints[endpoints_index++] = NO_PIECE;
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = NO_PIECE;
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = NO_PIECE;
-               }
-
-               if (move.start_rank == 1)
-               {
-                  endpoints[endpoints_index++] = move.start_file;
-                  endpoints[endpoints_index++] = move.start_rank + 2;
-                  endpoints[endpoints_index++] = NO_PIECE;
-               }
-            }
-            else
-            {
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank + 1;
-               endpoints[endpoints_index++] = 'B';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'B';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'B';
-               }
-
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank + 1;
-               endpoints[endpoints_index++] = 'N';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'N';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'N';
-               }
-
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank + 1;
-               endpoints[endpoints_index++] = 'R';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'R';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'R';
-               }
-
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank + 1;
-               endpoints[endpoints_index++] = 'Q';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'Q';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank + 1;
-                  endpoints[endpoints_index++] = 'Q';
-               }
-            }
-
-            break;
-
-         case 'p':
-
-            if (move.start_rank > 1)
-            {
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank - 1;
-               endpoints[endpoints_index++] = NO_PIECE;
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = NO_PIECE;
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = NO_PIECE;
-               }
-
-               if (move.start_rank == 6)
-               {
-                  endpoints[endpoints_index++] = move.start_file;
-                  endpoints[endpoints_index++] = move.start_rank - 2;
-                  endpoints[endpoints_index++] = NO_PIECE;
-               }
-            }
-            else
-            {
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank - 1;
-               endpoints[endpoints_index++] = 'b';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'b';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'b';
-               }
-
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank - 1;
-               endpoints[endpoints_index++] = 'n';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'n';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'n';
-               }
-
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank - 1;
-               endpoints[endpoints_index++] = 'r';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'r';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'r';
-               }
-
-               endpoints[endpoints_index++] = move.start_file;
-               endpoints[endpoints_index++] = move.start_rank - 1;
-               endpoints[endpoints_index++] = 'q';
-
-               if (move.start_file > 0)
-               {
-                  endpoints[endpoints_index++] = move.start_file - 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'q';
-               }
-
-               if (move.start_file < 7)
-               {
-                  endpoints[endpoints_index++] = move.start_file + 1;
-                  endpoints[endpoints_index++] = move.start_rank - 1;
-                  endpoints[endpoints_index++] = 'q';
-               }
-            }
-
-            break;
-
-         case 'B':
-         case 'b':
-
-            endpoints_index = PopulateBishopEndpoints(
-               move.start_file, move.start_rank, endpoints);
-            break;
-
-         case 'N':
-         case 'n':
-
-            endpoints_index = PopulateKnightEndpoints(
-               move.start_file, move.start_rank, endpoints);
-            break;
-
-         case 'R':
-         case 'r':
-
-            endpoints_index = PopulateRookEndpoints(
-               move.start_file, move.start_rank, endpoints);
-            break;
-
-         case 'Q':
-         case 'q':
-
-            endpoints_index = PopulateQueenEndpoints(
-               move.start_file, move.start_rank, endpoints);
-            break;
-
-         case 'K':
-         case 'k':
-
-            endpoints_index = PopulateKingEndpoints(
-               move.start_file, move.start_rank, endpoints);
-
-            // add castle possibilities
-
-            endpoints[endpoints_index++] = move.start_file - 2;
-            endpoints[endpoints_index++] = move.start_rank;
-            endpoints[endpoints_index++] = NO_PIECE;
-
-            endpoints[endpoints_index++] = move.start_file - 2;
-            endpoints[endpoints_index++] = move.start_rank;
-            endpoints[endpoints_index++] = NO_PIECE;
-
-            break;
-
-         default:
-            continue; // ???
-         }
+         if (!LeavesKingInCheck(*move))
+            ++count;
+      }
+   }
 
-         endpoints[endpoints_index] = MAGIC_NUM;
+   // pieces
 
-         for (endpoints_index = 0; endpoints[endpoints_index] != MAGIC_NUM; )
-         {
-            move.end_file = endpoints[endpoints_index++];
-            move.end_rank = endpoints[endpoints_index++];
-            move.promotion_piece = endpoints[endpoints_index++];
-
-            if (move.end_file <= 7 && move.end_rank <= 7 && IsMoveLegal(move))
-            {
-               if (buf == nullptr)
-                  return 1;
-               SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
-               buf[count++] = move;
-            }
-         }
+   const Bitboard piece_targets = targets & check_mask;
+
+   Bitboard pieces = m_pieces[GetPieceIndex(side, KNIGHT)] & ~pinned;
+   while (pieces != 0)
+   {
+      const unsigned char from = PopLowestSquare(&pieces);
+      count = AddMoves(
+         from, Bitboards::KnightAttacks(from) & piece_targets, buf, count);
+   }
+
+   pieces = m_pieces[GetPieceIndex(side, BISHOP)];
+   while (pieces != 0)
+   {
+      const unsigned char from = PopLowestSquare(&pieces);
+      count = AddMoves(from, Bitboards::BishopAttacks(from, occupied)
+         & piece_targets & GetPinMask(pinned, king, from), buf, count);
+   }
+
+   pieces = m_pieces[GetPieceIndex(side, ROOK)];
+   while (pieces != 0)
+   {
+      const unsigned char from = PopLowestSquare(&pieces);
+      count = AddMoves(from, Bitboards::RookAttacks(from, occupied)
+         & piece_targets & GetPinMask(pinned, king, from), buf, count);
+   }
+
+   pieces = m_pieces[GetPieceIndex(side, QUEEN)];
+   while (pieces != 0)
+   {
+      const unsigned char from = PopLowestSquare(&pieces);
+      count = AddMoves(from, Bitboards::QueenAttacks(from, occupied)
+         & piece_targets & GetPinMask(pinned, king, from), buf, count);
+   }
+
+   // the king may not step to an attacked square, including a square behind
+   // it on the line of a slider that checks it
+
+   Bitboard king_targets = Bitboards::KingAttacks(king) & targets;
+   const Bitboard occupied_without_king = occupied & ~king_mask;
+
+   while (king_targets != 0)
+   {
+      const unsigned char to = PopLowestSquare(&king_targets);
+      if (GetAttackers(enemy_side, to, occupied_without_king) == 0)
+      {
+         SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
+         SetMove(buf + count++, king, to, NO_PIECE);
       }
    }
 
+   if (!quiet_moves || checkers != 0)
+      return count;
+
+   // castle, where the king may not pass or land on an attacked square
+
+   const unsigned char rank = white ? 0 : 7;
+   const char rook = white ? 'R' : 'r';
+   const bool king_at_home = king == SQUARE(4, rank);
+   const bool may_castle_short = king_at_home && (m_castle_rights
+      & (white ? WHITE_CASTLE_SHORT : BLACK_CASTLE_SHORT)) != 0;
+   const bool may_castle_long = king_at_home && (m_castle_rights
+      & (white ? WHITE_CASTLE_LONG : BLACK_CASTLE_LONG)) != 0;
+
+   if (may_castle_short && m_squares[7][rank] == rook
+      && m_squares[5][rank] == NO_PIECE && m_squares[6][rank] == NO_PIECE
+      && !IsAttackingSquare(!white, SQUARE(5, rank))
+      && !IsAttackingSquare(!white, SQUARE(6, rank)))
+   {
+      SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
+      SetMove(buf + count++, SQUARE(4, rank), SQUARE(6, rank), NO_PIECE);
+   }
+
+   if (may_castle_long && m_squares[0][rank] == rook
+      && m_squares[1][rank] == NO_PIECE && m_squares[2][rank] == NO_PIECE
+      && m_squares[3][rank] == NO_PIECE
+      && !IsAttackingSquare(!white, SQUARE(3, rank))
+      && !IsAttackingSquare(!white, SQUARE(2, rank)))
+   {
+      SCRITTY_ASSERT(count < MAX_NUMBER_OF_LEGAL_MOVES);
+      SetMove(buf + count++, SQUARE(4, rank), SQUARE(2, rank), NO_PIECE);
+   }
+
+   return count;
+}
+
+size_t Position::ListAllLegalMoves(Move *buf /*= nullptr*/) const
+{
+   // pass in null buffer to test if there are any legal moves
+   // (returns 0 if no legal moves)
+
+   size_t count = 0;
+
+   // first check the position table (a position searched on a helper thread
+   // has none, since the table is not thread-safe)
+   if (m_position_table != nullptr
+      && m_position_table->Lookup(*this, buf, &count))
+   {
+      SCRITTY_ASSERT(++s_table_hits > 0);
+      return count;
+   }
+
+   SCRITTY_ASSERT(++s_table_misses > 0);
+
+   if (buf == nullptr)
+   {
+      Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+      return ListLegalMoves(moves) > 0 ? 1 : 0;
+   }
+
+   count = GenerateLegalMoves(buf);
+
    // save to position table
-   if (buf != nullptr)
+   if (m_position_table != nullptr)
       m_position_table->Save(*this, buf, count);
 
    return count;
 }
 
+size_t Position::GenerateLegalMoves(Move *buf) const
+{
+   const size_t count = ListLegalMoves(buf);
+   SCRITTY_ASSERT(count <= MAX_NUMBER_OF_LEGAL_MOVES);
+   return count;
+}
+
 Outcome Position::GetOutcome() const
 {
+   // Impossibility of checkmate - the game is drawn at once, whatever the
+   // position of the pieces
+
+   if (IsInsufficientMaterial())
+      return OUTCOME_DRAW;
+
    // check for checkmate or stalemate
 
    const size_t count = ListAllLegalMoves();
@@ -1701,71 +1503,125 @@ Outcome Position::GetOutcome() const
    return OUTCOME_UNDECIDED;
 }
 
-unsigned int Position::GetHash() const
+HashKey Position::CalculateHash() const
 {
-   if (m_hash == POSITION_HASH_MODULUS)
+   // the incremental hash must always match this
+
+   HashKey hash = Zobrist::CastleKey(m_castle_rights);
+
+   for (unsigned char file = 0; file <= 7; ++file)
    {
-      // should be uniform and fairly fast
-      // inspired by CBC-MAC
+      for (unsigned char rank = 0; rank <= 7; ++rank)
+      {
+         const int piece_index = GetPieceIndex(m_squares[file][rank]);
 
-      unsigned __int64 x = m_en_passant_allowed_on;
+         if (piece_index != PIECE_INDEX_COUNT)
+            hash ^= Zobrist::PieceKey(piece_index, SQUARE(file, rank));
+      }
+   }
 
-      if (m_white_to_move)
-         x += 256;
+   if (m_en_passant_allowed_on != NO_EN_PASSANT)
+      hash ^= Zobrist::EnPassantKey(m_en_passant_allowed_on);
 
-      if (m_black_may_castle_long)
-         x += 512;
+   if (!m_white_to_move)
+      hash ^= Zobrist::BlackToMoveKey();
 
-      if (m_black_may_castle_short)
-         x += 1024;
+   return hash;
+}
+
+PositionTable::PositionTable(
+   size_t megabytes /*= DEFAULT_POSITION_TABLE_MEGABYTES*/)
+   : m_entries(nullptr), m_arena(nullptr)
+{
+   Resize(megabytes);
+}
 
-      if (m_white_may_castle_long)
-         x += 2048;
+PositionTable::~PositionTable()
+{
+   SCRITTY_ASSERT(m_entries != nullptr);
+   delete[] m_entries;
+   m_entries = nullptr;
 
-      if (m_white_may_castle_short)
-         x += 4096;
+   SCRITTY_ASSERT(m_arena != nullptr);
+   delete[] m_arena;
+   m_arena = nullptr;
+}
 
-      x = powmod(x);
+void PositionTable::Resize(size_t megabytes)
+{
+   delete[] m_entries;
+   delete[] m_arena;
 
-      x = powmod(*((unsigned __int64 *)(m_squares[0])) ^ x);
-      x = powmod(*((unsigned __int64 *)(m_squares[1])) ^ x);
-      x = powmod(*((unsigned __int64 *)(m_squares[2])) ^ x);
-      x = powmod(*((unsigned __int64 *)(m_squares[3])) ^ x);
-      x = powmod(*((unsigned __int64 *)(m_squares[4])) ^ x);
-      x = powmod(*((unsigned __int64 *)(m_squares[5])) ^ x);
-      x = powmod(*((unsigned __int64 *)(m_squares[6])) ^ x);
-      x = powmod(*((unsigned __int64 *)(m_squares[7])) ^ x);
+   // split the memory between the index and the arena by the average size of
+   // a move list
 
-      m_hash = (unsigned int)x;
-   }
+   const size_t bytes = megabytes*1024*1024;
+   const size_t bucket_bytes
+      = POSITION_TABLE_BUCKET_SIZE*sizeof(PositionTableEntry);
 
-   return m_hash;
+   m_bucket_count = bytes / (bucket_bytes + POSITION_TABLE_BUCKET_SIZE
+      *AVERAGE_NUMBER_OF_LEGAL_MOVES*sizeof(unsigned short));
+   if (m_bucket_count < 1)
+      m_bucket_count = 1;
+
+   m_entries = new PositionTableEntry[
+      (size_t)m_bucket_count*POSITION_TABLE_BUCKET_SIZE];
+
+   // the arena must at least hold the longest list
+   m_arena_size = bytes > m_bucket_count*bucket_bytes
+      ? (bytes - m_bucket_count*bucket_bytes) / sizeof(unsigned short) : 0;
+   if (m_arena_size < MAX_NUMBER_OF_LEGAL_MOVES)
+      m_arena_size = MAX_NUMBER_OF_LEGAL_MOVES;
+
+   m_arena = new unsigned short[(size_t)m_arena_size];
+
+   Clear();
+}
+
+void PositionTable::Clear()
+{
+   memset(m_entries, 0, (size_t)m_bucket_count
+      *POSITION_TABLE_BUCKET_SIZE*sizeof(PositionTableEntry));
+   m_arena_cursor = 0;
 }
 
 void PositionTable::Save(const Position &position, const Move* possible_moves,
    size_t possible_moves_size)
 {
    SCRITTY_ASSERT(possible_moves != nullptr);
+   SCRITTY_ASSERT(possible_moves_size < MAX_NUMBER_OF_LEGAL_MOVES);
+
+   // replace the same position, an entry whose moves have been overwritten
+   // or else the oldest entry in the bucket
+
+   PositionTableEntry *bucket = GetBucket(position.GetHash());
+   PositionTableEntry *entry = bucket;
+
+   for (size_t i = 0; i < POSITION_TABLE_BUCKET_SIZE; ++i)
+   {
+      if (bucket[i].key == position.GetHash() || !IsValid(bucket[i]))
+      {
+         entry = bucket + i;
+         break;
+      }
+
+      if (bucket[i].start < entry->start)
+         entry = bucket + i;
+   }
 
-   // save the entry
-   PositionTableElement *element = m_table + position.GetHash();
-   CalculatedPosition *calculated = element->m_head;
-   calculated->position = position; // copy
-   memcpy(calculated->possible_moves, possible_moves,
-      sizeof(Move)*possible_moves_size);
-   calculated->possible_moves_size = possible_moves_size;
-
-   // advanced the head
-   ++(element->m_head);
-
-   // move the head back to the beginning if we have passed the end
-   if (element->m_head
-      == element->m_positions + MAX_CALCULATED_POSITIONS_PER_ELEMENT)
-      element->m_head = element->m_positions;
-
-   // increase valid entries if we have not maxed out
-   if (element->m_valid_entries < MAX_CALCULATED_POSITIONS_PER_ELEMENT)
-      ++(element->m_valid_entries);
+   // a list never wraps around the end of the arena
+   if (m_arena_cursor % m_arena_size + possible_moves_size > m_arena_size)
+      m_arena_cursor += m_arena_size - m_arena_cursor % m_arena_size;
+
+   unsigned short *packed = m_arena + (size_t)(m_arena_cursor % m_arena_size);
+   for (size_t i = 0; i < possible_moves_size; ++i)
+      packed[i] = possible_moves[i].Pack();
+
+   entry->key = position.GetHash();
+   entry->start = m_arena_cursor;
+   entry->count = possible_moves_size;
+
+   m_arena_cursor += possible_moves_size;
 }
 
 bool PositionTable::Lookup(const Position &position, Move* possible_moves,
@@ -1775,34 +1631,22 @@ bool PositionTable::Lookup(const Position &position, Move* possible_moves,
 
    SCRITTY_ASSERT(possible_moves_size != nullptr);
 
-   PositionTableElement *element = m_table + position.GetHash();
-
-   // start with last inserted and work backwards
+   const PositionTableEntry *bucket = GetBucket(position.GetHash());
 
-   CalculatedPosition *cursor = element->m_head;
-
-   for (size_t entries_checked = 0; entries_checked < element->m_valid_entries;
-      ++entries_checked)
+   for (size_t i = 0; i < POSITION_TABLE_BUCKET_SIZE; ++i)
    {
-      // move the cursor back one
-      --cursor;
-
-      // maybe move the cursor to the end of the buffer
-
-      if (cursor < element->m_positions)
-         cursor
-         = element->m_positions + MAX_CALCULATED_POSITIONS_PER_ELEMENT - 1;
-
-      // check the cursor
-      if (cursor->position == position)
+      if (bucket[i].key == position.GetHash() && IsValid(bucket[i]))
       {
          // found
 
+         const unsigned short *packed
+            = m_arena + (size_t)(bucket[i].start % m_arena_size);
+
          if (possible_moves != nullptr)
-            memcpy(possible_moves, cursor->possible_moves,
-            sizeof(Move)*cursor->possible_moves_size);
+            for (size_t j = 0; j < bucket[i].count; ++j)
+               possible_moves[j].Unpack(packed[j]);
 
-         *possible_moves_size = cursor->possible_moves_size;
+         *possible_moves_size = (size_t)bucket[i].count;
          return true;
       }
    }
@@ -1813,23 +1657,17 @@ bool PositionTable::Lookup(const Position &position, Move* possible_moves,
 
 void PositionTable::PrintStats() const
 {
-   size_t entry_counts[MAX_CALCULATED_POSITIONS_PER_ELEMENT + 1];
-
-   for (size_t i = 0; i < MAX_CALCULATED_POSITIONS_PER_ELEMENT; ++i)
-      entry_counts[i] = 0;
-
-   for (size_t i = 0; i < POSITION_HASH_MODULUS; ++i)
-      ++entry_counts[m_table[i].m_valid_entries];
-
-   std::cout << "Position Table Counts:" << std::endl;
-   size_t total = 0;
-
-   for (size_t i = 0; i < MAX_CALCULATED_POSITIONS_PER_ELEMENT; ++i)
-   {
-      std::cout << i << ": " << entry_counts[i] << std::endl;
-      if (i > 0)
-         total += entry_counts[i];
-   }
-
-   std::cout << "Total non-zero: " << total << std::endl;
+   const size_t entry_count
+      = (size_t)m_bucket_count*POSITION_TABLE_BUCKET_SIZE;
+   size_t valid_count = 0;
+
+   for (size_t i = 0; i < entry_count; ++i)
+      if (IsValid(m_entries[i]))
+         ++valid_count;
+
+   std::cout << "Position Table:" << std::endl;
+   std::cout << "Valid entries: " << valid_count << " of " << entry_count
+      << std::endl;
+   std::cout << "Moves written: " << m_arena_cursor << " (arena holds "
+      << m_arena_size << ")" << std::endl;
 }
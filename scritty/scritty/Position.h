@@ -5,19 +5,32 @@
 
 #include <string>
 #include "scritty.h"
+#include "Bitboard.h"
+#include "Zobrist.h"
 
 #define NO_PIECE '\0'
 #define NO_EN_PASSANT 100
 
-// TODO P4: seems reasonable, but make sure I've got asserts
-#define MAX_NUMBER_OF_LEGAL_MOVES 200
+// the most in any legal position is 218, and the position table keeps a
+// count of fewer than 256
+#define MAX_NUMBER_OF_LEGAL_MOVES 256
 
 #define MAX_POSITION_CHAIN_LEN 1000 // 500 moves
-#define MAX_CALCULATED_POSITIONS_PER_ELEMENT 10
-#define POSITION_HASH_MODULUS 43997 // 2 is a primitive root of this prime
+#define FIFTY_MOVE_RULE_PLIES 100 // without a capture or pawn move
+#define DEFAULT_POSITION_TABLE_MEGABYTES 4
+#define POSITION_TABLE_BUCKET_SIZE 4
+#define AVERAGE_NUMBER_OF_LEGAL_MOVES 32 // for sizing the move arena
+
+// castle rights bits
+#define WHITE_CASTLE_SHORT 0x01
+#define WHITE_CASTLE_LONG 0x02
+#define BLACK_CASTLE_SHORT 0x04
+#define BLACK_CASTLE_LONG 0x08
+#define ALL_CASTLE_RIGHTS 0x0f
 
 namespace scritty
 {
+   // plain data, so the compiler copies moves and lists of them as blocks
    class Move
    {
    public:
@@ -27,9 +40,37 @@ namespace scritty
       unsigned char end_rank;
       char promotion_piece; // NO_PIECE for none
 
-      void ToString(std::string *str);
-      bool operator==(const Move &other) const;
-      Move& operator=(const Move &rhs);
+      void ToString(std::string *str) const;
+
+      bool operator==(const Move &other) const
+      {
+         return start_file == other.start_file
+            && start_rank == other.start_rank
+            && end_file == other.end_file
+            && end_rank == other.end_rank
+            && promotion_piece == other.promotion_piece;
+      }
+
+      // 6 bits start square, 6 bits end square, 3 bits promotion piece
+      unsigned short Pack() const;
+      void Unpack(unsigned short packed);
+   };
+
+   // everything needed to take back a move that the move itself does not tell
+   class UndoRecord
+   {
+   public:
+      Move move;
+      char moved_piece;
+      char captured_piece; // NO_PIECE for none
+      unsigned char captured_file; // differs from end square for en passant
+      unsigned char captured_rank;
+      unsigned char castle_rights;
+      unsigned char en_passant_allowed_on;
+      unsigned short halfmove_clock;
+      unsigned short plies_from_null;
+      HashKey hash;
+      Bitboard checkers;
    };
 
    class PositionTable; // forward
@@ -40,14 +81,14 @@ namespace scritty
 
       // normally use this constructor
       Position(
-         Position *chain, size_t *chain_length, PositionTable *position_table)
+         UndoRecord *chain, size_t *chain_length, PositionTable *position_table)
          : m_chain(chain), m_position_table(position_table),
-         m_chain_length(chain_length), m_hash(POSITION_HASH_MODULUS)
+         m_chain_length(chain_length)
       {
          SetToStartPos();
       }
 
-      // use this constructor for initializing an empty position chain
+      // use this constructor for initializing an empty position table
       Position() {} // note: does zero setup
 
       ~Position()
@@ -55,43 +96,95 @@ namespace scritty
       }
 
       void SetToStartPos();
+      bool SetToFen(const std::string &fen); // false (and unchanged) if bad
+      void SetToPosition(const Position &other); // only reversible history
       void ApplyKnownLegalMove(const Move &move);
       void RollBackOneMove();
+
+      // passes the turn, for null move pruning (never a legal move in chess,
+      // so not for a side in check)
+      void ApplyNullMove();
+      void RollBackNullMove();
+
+      // false at the start of the chain or after a null move
+      bool GetLastMove(Move *move) const;
+
+      // false when the side has only its king and pawns, where passing the
+      // turn may well be better than any move (zugzwang)
+      bool HasPiecesOtherThanPawns(Side side) const
+      {
+         return (m_side_pieces[side] & ~m_pieces[GetPieceIndex(side, PAWN)]
+            & ~m_pieces[GetPieceIndex(side, KING)]) != 0;
+      }
+
       bool operator==(const Position &other) const;
       bool MayClaimDraw() const;
+      bool IsInsufficientMaterial() const; // neither side can ever mate
       bool IsWhiteToMove() const { return m_white_to_move; }
       bool IsMoveLegal(const Move &move) const;
       Outcome GetOutcome() const;
       bool IsCheck(bool white) const;
+
+      // the pieces giving check to the side to move
+      Bitboard GetCheckers() const { return m_checkers; }
       size_t ListAllLegalMoves(Move *buf = nullptr) const;
+      size_t GenerateLegalMoves(Move *buf) const; // bypasses position table
+
+      // legal moves for generating in stages, bypassing the position table
+      // captures include en passant and all promotions
+      size_t ListCaptures(Move *buf) const
+      {
+         return ListLegalMoves(buf, true, false);
+      }
+
+      size_t ListQuietMoves(Move *buf) const
+      {
+         return ListLegalMoves(buf, false, true);
+      }
 
       char GetPieceAt(unsigned char file, unsigned char rank) const
       {
          return m_squares[file][rank];
       }
 
+      Bitboard GetPieces(int piece_index) const
+      {
+         return m_pieces[piece_index];
+      }
+
+      Bitboard GetSidePieces(Side side) const
+      {
+         return m_side_pieces[side];
+      }
+
+      Bitboard GetOccupied() const
+      {
+         return m_side_pieces[WHITE] | m_side_pieces[BLACK];
+      }
+
       static inline bool IsOpponentsPiece(char mine, char theirs);
 
       bool IsRookMoveLegal(const Move &move) const;
       bool IsBishopMoveLegal(const Move &move) const;
       bool IsKnightMoveLegal(const Move &move) const;
 
-      size_t PopulateBishopEndpoints(unsigned char start_file,
-         unsigned char start_rank, unsigned char *endpoints) const;
-      size_t PopulateKnightEndpoints(unsigned char start_file,
-         unsigned char start_rank, unsigned char *endpoints) const;
-      size_t PopulateRookEndpoints(unsigned char start_file,
-         unsigned char start_rank, unsigned char *endpoints) const;
-      size_t PopulateQueenEndpoints(unsigned char start_file,
-         unsigned char start_rank, unsigned char *endpoints) const;
-      size_t PopulateKingEndpoints(unsigned char start_file,
-         unsigned char start_rank, unsigned char *endpoints) const;
-
       bool IsAttackingSquare(
          bool white, unsigned char file, unsigned char rank) const;
+      bool IsAttackingSquare(bool white, unsigned char square) const;
+
+      // the centipawns the side to move wins with the move if both sides go
+      // on capturing on its end square, least valuable piece first, for as
+      // long as it pays them (static exchange evaluation)
+      int EvaluateExchange(const Move &move) const;
+
+      static int GetExchangeValue(PieceType type) // centipawns
+      {
+         return s_exchange_values[type];
+      }
       bool IsMoveLegal(const Move &move, bool white, bool check_king) const;
 
-      unsigned int GetHash() const;
+      HashKey GetHash() const { return m_hash; }
+      HashKey CalculateHash() const; // slow, for verifying the incremental hash
 
    protected:
 
@@ -99,34 +192,78 @@ namespace scritty
       // object to copy must have a valid position chain
       Position (const Position &to_copy)
          : m_white_to_move(to_copy.m_white_to_move),
-         m_white_may_castle_short(to_copy.m_white_may_castle_short),
-         m_white_may_castle_long(to_copy.m_white_may_castle_long),
-         m_black_may_castle_short(to_copy.m_black_may_castle_short),
-         m_black_may_castle_long(to_copy.m_black_may_castle_long),
+         m_castle_rights(to_copy.m_castle_rights),
          m_en_passant_allowed_on(to_copy.m_en_passant_allowed_on),
+         m_halfmove_clock(to_copy.m_halfmove_clock),
+         m_plies_from_null(to_copy.m_plies_from_null),
          m_chain(to_copy.m_chain), m_chain_length(to_copy.m_chain_length),
-         m_hash(to_copy.m_hash), m_position_table(to_copy.m_position_table)
+         m_hash(to_copy.m_hash), m_position_table(to_copy.m_position_table),
+         m_checkers(to_copy.m_checkers)
       {
          memcpy(m_squares, to_copy.m_squares, sizeof(to_copy.m_squares));
+         memcpy(m_pieces, to_copy.m_pieces, sizeof(to_copy.m_pieces));
+         memcpy(m_side_pieces, to_copy.m_side_pieces,
+            sizeof(to_copy.m_side_pieces));
+      }
+
+      // the mailbox and the bitboards must always be changed together
+      void PlacePiece(unsigned char file, unsigned char rank, char piece);
+      void RemovePiece(unsigned char file, unsigned char rank);
+      void SynchronizeBitboards(); // rebuilds the bitboards from the mailbox
+      Bitboard FindCheckers() const; // of the side to move, from scratch
+
+      size_t ListLegalMoves(
+         Move *buf, bool captures = true, bool quiet_moves = true) const;
+      size_t ListPawnMoves(Bitboard pawns, Bitboard allowed, bool captures,
+         bool quiet_moves, Move *buf, size_t count) const;
+      Bitboard GetAttackers(
+         Side side, unsigned char square, Bitboard occupied) const;
+
+      // the squares a piece may move to without exposing the king
+      static Bitboard GetPinMask(
+         Bitboard pinned, unsigned char king, unsigned char from)
+      {
+         return (pinned & SquareMask(from)) != 0
+            ? Bitboards::Line(king, from) : ~0ull;
       }
+      bool LeavesKingInCheck(const Move &move) const;
 
       char m_squares[8][8];
+      Bitboard m_pieces[PIECE_INDEX_COUNT];
+      Bitboard m_side_pieces[2]; // indexed by Side
       bool m_white_to_move;
-      bool m_white_may_castle_short, m_white_may_castle_long;
-      bool m_black_may_castle_short, m_black_may_castle_long;
+      unsigned char m_castle_rights;
       unsigned char m_en_passant_allowed_on;
+      unsigned short m_halfmove_clock; // plies since a capture or pawn move
+      unsigned short m_plies_from_null; // repetitions stop at a null move
 
-      Position *m_chain;
+      UndoRecord *m_chain;
       size_t *m_chain_length;
       PositionTable *m_position_table;
-      mutable unsigned int m_hash; // not valuable for comparison
+      HashKey m_hash; // kept up to date by every change to the position
+
+      // found once per move, since the search asks about check at every
+      // node, and so does move generation
+      Bitboard m_checkers;
 
       static size_t s_table_hits, s_table_misses;
+      static const int s_exchange_values[PIECE_TYPE_COUNT];
    };
 
+   // caches the legal moves of positions
+   // the moves are packed into an arena that is written in a circle, so a list
+   // is lost once the arena wraps around to it, and the index entries only
+   // point into the arena
    class PositionTable
    {
    public:
+      PositionTable(size_t megabytes = DEFAULT_POSITION_TABLE_MEGABYTES);
+      ~PositionTable();
+
+      // also clears the table
+      void Resize(size_t megabytes);
+
+      void Clear();
 
       // returns false if not found
       bool Lookup(const Position &position, Move* possible_moves,
@@ -140,51 +277,34 @@ namespace scritty
       void PrintStats() const;
 
    private:
+      PositionTable(const PositionTable &); // copy disallowed
 
-      struct CalculatedPosition
+      struct PositionTableEntry
       {
-         Position position;
-         Move possible_moves[MAX_NUMBER_OF_LEGAL_MOVES];
-         size_t possible_moves_size;
+         HashKey key;
+         unsigned __int64 start : 56; // counts arena writes since clearing
+         unsigned __int64 count : 8;
       };
 
-      class PositionTableElement
+      bool IsValid(const PositionTableEntry &entry) const
       {
-      public:
-         PositionTableElement() : m_head(m_positions), m_valid_entries(0)
-         {
-         }
-
-         CalculatedPosition *m_head; // next to overwrite
-         size_t m_valid_entries;
-         CalculatedPosition m_positions[MAX_CALCULATED_POSITIONS_PER_ELEMENT];
-      };
-
-      PositionTableElement m_table[POSITION_HASH_MODULUS];
-   };
-
-   inline unsigned __int64 powmod(unsigned __int64 x)
-   {
-      // calculates 2^x mod POSITION_HASH_MODULUS
-
-      // shorten with totient
-      // (I knew that number theory class would pay off one day)
-      x %= POSITION_HASH_MODULUS - 1;
-
-      unsigned __int64 h = 1;
-      unsigned __int64 b = 2;
+         // valid until the arena has come all the way around to its moves
+         return entry.key != 0 && m_arena_cursor - entry.start <= m_arena_size;
+      }
 
-      while (x > 0)
+      PositionTableEntry *GetBucket(HashKey key) const
       {
-         if (x & 1)
-            h = (h*b) % POSITION_HASH_MODULUS;
-         x >>= 1;
-         h %= POSITION_HASH_MODULUS;
-         b = (b*b) % POSITION_HASH_MODULUS;
+         // any number of buckets can be used (see TranspositionTable)
+         return m_entries + (size_t)(((key >> 32)*m_bucket_count) >> 32)
+            *POSITION_TABLE_BUCKET_SIZE;
       }
 
-      return h;
-   }
+      PositionTableEntry *m_entries;
+      HashKey m_bucket_count;
+      unsigned short *m_arena;
+      unsigned __int64 m_arena_size;
+      unsigned __int64 m_arena_cursor; // next write (modulo the arena size)
+   };
 }
 
 #endif // #ifndef SCRITTY_POSITION_H
@@ -4,11 +4,32 @@
 #include <iostream>
 #include "scritty.h"
 #include "UCIHandler.h"
+#include "MovePicker.h"
 
 using namespace scritty;
 
-SearchingEngine::SearchingEngine() : GeneticEngine()
+// only a thread itself counts its nodes, so the count needs no locked add
+static size_t CountNode(SearchThread *thread)
 {
+   const size_t nodes
+      = thread->nodes_searched.load(std::memory_order_relaxed) + 1;
+   thread->nodes_searched.store(nodes, std::memory_order_relaxed);
+   return nodes;
+}
+
+SearchingEngine::SearchingEngine() : GeneticEngine(),
+   m_transposition_table(new TranspositionTable),
+   m_thread_pool(new ThreadPool), m_stop(false), m_stop_requested(false),
+   m_pondering(false), m_start_tick_count(0), m_found_move(false),
+   m_found_ponder_move(false), m_score(0)
+{
+   for (size_t i = 0; i < MAX_THREADS; ++i)
+   {
+      m_threads[i].chain = nullptr;
+      m_threads[i].stack = nullptr;
+      m_threads[i].history = nullptr;
+   }
+
    m_parameters_size = 5;
    m_parameters = new ParameterPair[m_parameters_size];
 
@@ -39,7 +60,7 @@ SearchingEngine::SearchingEngine() : GeneticEngine()
    SCRITTY_ASSERT(i < m_parameters_size);
    strcpy_s(m_parameters[i].name, MAX_PARAMETER_NAME_LEN + 1,
       "Square Control Value");
-   m_parameters[i++].value = 0.01;
+   m_parameters[i++].value = 0.03; // per controlled square
 }
 
 SearchingEngine *SearchingEngine::Clone() const
@@ -57,264 +78,694 @@ SearchingEngine *SearchingEngine::Clone() const
    return clone;
 }
 
-Outcome SearchingEngine::GetBestMove(std::string *best) const
+/*virtual*/ void SearchingEngine::SetHashSize(size_t megabytes)
+{
+   // the position table only needs a quarter as much as the search does
+
+   const size_t position_table_megabytes = megabytes / 4;
+   m_position_table->Resize(position_table_megabytes);
+   m_transposition_table->Resize(megabytes - position_table_megabytes);
+}
+
+/*virtual*/ void SearchingEngine::SetThreadCount(size_t thread_count)
+{
+   m_thread_pool->Resize(thread_count);
+}
+
+/*virtual*/ void SearchingEngine::SetSearchLimits(const SearchLimits &limits)
 {
-   // the move buffer for all depths is allocated once for performance
-   Move *move_buffer = new Move[MAX_SEARCH_DEPTH*MAX_NUMBER_OF_LEGAL_MOVES];
-   Move move, suggestion, *move_ptr;
+   m_limits = limits;
+   m_stop_requested = false;
+   m_pondering = limits.ponder;
+}
+
+/*virtual*/ void SearchingEngine::StopSearch()
+{
+   // the main thread sees the request the next time it checks the limits
+   m_stop_requested = true;
+}
+
+/*virtual*/ void SearchingEngine::PonderHit()
+{
+   // the time limits are planned as if the search started now, so the time
+   // spent pondering comes on top
+   m_start_tick_count = ::GetTickCount64();
+   m_pondering = false;
+}
 
-   // first pass
+/*virtual*/ void SearchingEngine::GetPonderMove(std::string *ponder) const
+{
+   ponder->clear();
 
-   move_ptr = &suggestion;
+   if (m_found_ponder_move)
+      m_ponder_move.ToString(ponder);
+}
 
-   double evaluation
-      = GetBestMove(*m_position, nullptr, FIRST_PASS_SEARCH_DEPTH,
-      -DBL_MAX, DBL_MAX, m_position->IsWhiteToMove(), &move_ptr, move_buffer);
+Outcome SearchingEngine::GetBestMove(std::string *best) const
+{
+   m_transposition_table->NewSearch();
+
+   m_stop = false;
+   m_start_tick_count = ::GetTickCount64();
+   PlanSearch();
 
-   if (move_ptr == nullptr)
+   m_thread_pool->Start(SearchTask, (void*)this);
+   m_thread_pool->Wait();
+
+   if (!m_found_move)
    {
       // no moves available, so give up only at this point
-      delete[] move_buffer;
-      if (evaluation == 0.0)
+      if (m_score == 0)
          return OUTCOME_DRAW;
       return m_position->GetOutcome();
    }
 
-   // final pass
-   move_ptr = &move;
-   m_nodes_searched = 0;
-   m_start_tick_count = ::GetTickCount64();
-   evaluation = GetBestMove(*m_position, &suggestion, MAX_SEARCH_DEPTH,
-      -DBL_MAX, DBL_MAX, m_position->IsWhiteToMove(), &move_ptr, move_buffer);
-
-   SCRITTY_ASSERT(move_ptr != nullptr);
-   SCRITTY_ASSERT(move.start_file <= 7 && move.start_rank <= 7
-      && move.end_file <= 7 && move.end_rank <= 7);
+   SCRITTY_ASSERT(m_best_move.start_file <= 7 && m_best_move.start_rank <= 7
+      && m_best_move.end_file <= 7 && m_best_move.end_rank <= 7);
 
-   delete[] move_buffer;
-   move.ToString(best);
+   m_best_move.ToString(best);
 
    return OUTCOME_UNDECIDED; // don't ever give up
 }
 
-double SearchingEngine::GetBestMove(const Position &position,
-   const Move *suggestion,
-   size_t current_depth, double alpha, double beta, bool maximize,
-   Move **best, Move *move_buffer) const
+void SearchingEngine::PlanSearch() const
+{
+   m_max_depth = m_limits.depth;
+   m_soft_time_limit = m_limits.move_time;
+   m_hard_time_limit = m_limits.move_time;
+
+   const bool white = m_position->IsWhiteToMove();
+   const unsigned __int64 time
+      = white ? m_limits.white_time : m_limits.black_time;
+   const unsigned __int64 increment
+      = white ? m_limits.white_increment : m_limits.black_increment;
+
+   if (m_limits.move_time == 0 && time > 0)
+   {
+      // plan an equal share of the time to the next control, but allow a
+      // search to run over its plan (to finish an iteration) rather than
+      // waste a deep iteration that is almost done
+
+      const size_t moves_to_go = m_limits.moves_to_go > 0
+         ? m_limits.moves_to_go : MOVES_TO_GO_GUESS;
+      const unsigned __int64 available = time > TIME_SAFETY_MARGIN
+         ? time - TIME_SAFETY_MARGIN : 1;
+
+      m_soft_time_limit = time / moves_to_go + increment;
+      m_hard_time_limit = m_soft_time_limit*HARD_TIME_LIMIT_FACTOR;
+
+      if (m_hard_time_limit > available)
+         m_hard_time_limit = available;
+      if (m_soft_time_limit > m_hard_time_limit)
+         m_soft_time_limit = m_hard_time_limit;
+   }
+
+   if (m_max_depth == 0 || m_max_depth > MAX_SEARCH_DEPTH)
+   {
+      // with no limits at all, search to a fixed depth
+      m_max_depth = m_soft_time_limit == 0 && m_limits.nodes == 0
+         && !m_limits.infinite ? DEFAULT_SEARCH_DEPTH : MAX_SEARCH_DEPTH;
+   }
+}
+
+void SearchingEngine::CheckLimits(const SearchThread *thread) const
+{
+   // only called by the main thread, which must complete an iteration to have
+   // a move to report
+
+   if (thread->completed_depth == 0)
+      return;
+
+   if (m_stop_requested)
+   {
+      m_stop = true;
+      return;
+   }
+
+   if (m_pondering)
+      return;
+
+   if ((m_hard_time_limit > 0 && GetElapsedTime() >= m_hard_time_limit)
+      || (m_limits.nodes > 0 && GetNodesSearched() >= m_limits.nodes))
+      m_stop = true;
+}
+
+/*static*/ void SearchingEngine::SearchTask(void *context, size_t thread_index)
+{
+   ((const SearchingEngine*)context)->Search(thread_index);
+}
+
+void SearchingEngine::Search(size_t thread_index) const
+{
+   SearchThread *thread = m_threads + thread_index;
+   thread->index = thread_index;
+   thread->extra_depth = thread_index % 2 == 1 ? HELPER_EXTRA_DEPTH : 0;
+   thread->nodes_searched = 0;
+   thread->completed_depth = 0;
+   thread->pv_length = 0;
+
+   if (thread->stack == nullptr)
+   {
+      thread->chain = new UndoRecord[MAX_POSITION_CHAIN_LEN];
+      thread->stack = new SearchPly[SEARCH_STACK_SIZE];
+      thread->history = new MoveHistory;
+   }
+
+   // what the last search learned about quiet moves is not for this one
+   for (size_t ply = 0; ply < SEARCH_STACK_SIZE; ++ply)
+      memset(thread->stack[ply].killers, 0,
+         sizeof(thread->stack[ply].killers)); // a1a1 is never legal
+   thread->history->Clear();
+
+   // each thread makes moves on its own copy of the position
+   // only the main thread uses the position table, which is not thread-safe
+
+   size_t chain_length = 0;
+   Position position(thread->chain, &chain_length,
+      thread_index == 0 ? m_position_table : nullptr);
+   position.SetToPosition(*m_position);
+   thread->position = &position;
+
+   // iterative deepening: each iteration orders its moves by what the last
+   // one found, which makes it cheap compared to searching straight to depth
+
+   Move best_move;
+   int score = 0;
+   bool found_move = false;
+
+   for (size_t depth = 1; depth <= m_max_depth && !m_stop; ++depth)
+   {
+      thread->root_depth = depth + thread->extra_depth;
+      if (thread->root_depth > MAX_SEARCH_DEPTH)
+         break;
+
+      Move move;
+      Move *move_ptr = &move;
+
+      const int iteration_score = GetBestMove(thread,
+         thread->pv_length > 0 ? thread->pv : nullptr, 0, thread->root_depth,
+         -SCORE_INFINITE, SCORE_INFINITE, &move_ptr, false);
+
+      if (m_stop)
+         break; // the unfinished iteration is thrown away
+
+      thread->completed_depth = thread->root_depth;
+      score = iteration_score;
+      found_move = move_ptr != nullptr;
+
+      if (!found_move)
+         break; // no legal moves
+
+      best_move = move;
+      ExtractPrincipalVariation(thread, best_move);
+
+      if (thread_index == 0)
+      {
+         SendIterationInfo(thread, score);
+
+         if (m_stop_requested)
+            break;
+
+         // a new iteration would not finish in time (no limits apply while
+         // pondering)
+         if (!m_pondering && ((m_soft_time_limit > 0
+            && GetElapsedTime() >= m_soft_time_limit)
+            || (m_limits.nodes > 0 && GetNodesSearched() >= m_limits.nodes)))
+            break;
+      }
+   }
+
+   if (thread_index == 0)
+   {
+      // an infinite search only ever ends by being stopped, and pondering
+      // must not end before the opponent has moved
+      while ((m_limits.infinite || m_pondering) && !m_stop_requested)
+         ::Sleep(1);
+
+      // the main thread's result is the result of the search, so the helpers
+      // can stop (their results are only in the transposition table)
+
+      m_stop = true;
+
+      m_found_move = found_move;
+      m_best_move = best_move;
+      m_found_ponder_move = found_move && thread->pv_length > 1;
+      if (m_found_ponder_move)
+         m_ponder_move = thread->pv[1];
+      m_score = score;
+   }
+}
+
+void SearchingEngine::ExtractPrincipalVariation(
+   SearchThread *thread, const Move &best) const
 {
-   ++m_nodes_searched;
+   // the best move of each position along the variation is in the
+   // transposition table, unless it has been replaced since
+
+   Position &position = *thread->position;
+
+   thread->pv[0] = best;
+   thread->pv_length = 1;
+   position.ApplyKnownLegalMove(best);
+
+   TranspositionEntry entry;
+   while (thread->pv_length < thread->root_depth
+      && m_transposition_table->Probe(position.GetHash(), &entry)
+      && position.IsMoveLegal(entry.best_move))
+   {
+      thread->pv[thread->pv_length++] = entry.best_move;
+      position.ApplyKnownLegalMove(entry.best_move);
+   }
+
+   for (size_t i = 0; i < thread->pv_length; ++i)
+      position.RollBackOneMove();
+}
+
+void SearchingEngine::SendIterationInfo(
+   const SearchThread *thread, int score) const
+{
+   const size_t nodes_searched = GetNodesSearched();
+   const unsigned __int64 elapsed = GetElapsedTime();
+
+   std::stringstream ss;
+   ss << "depth " << thread->completed_depth << " ";
+
+   // a mate is given in moves, negative if the engine is being mated
+   if (score >= SCORE_MATE_BOUND)
+      ss << "score mate " << (SCORE_MATE - score + 1) / 2 << " ";
+   else if (score <= -SCORE_MATE_BOUND)
+      ss << "score mate " << -(SCORE_MATE + score) / 2 << " ";
+   else
+      ss << "score cp " << score << " ";
+
+   ss << "time " << elapsed << " ";
+   ss << "nodes " << nodes_searched << " ";
+   ss << "nps " << (elapsed > 0 ? 1000*nodes_searched / elapsed : 0) << " ";
+   ss << "pv";
+
+   for (size_t i = 0; i < thread->pv_length; ++i)
+   {
+      std::string move;
+      thread->pv[i].ToString(&move);
+      ss << " " << move;
+   }
+
+   UCIHandler::send_info(ss.str());
+}
+
+void SearchingEngine::SendCurrentMoveInfo(
+   const Move &move, size_t move_index) const
+{
+   std::string str;
+   move.ToString(&str);
+
+   std::stringstream ss;
+   ss << "currmove " << str << " currmovenumber " << (move_index + 1);
+   UCIHandler::send_info(ss.str());
+}
+
+size_t SearchingEngine::GetNodesSearched() const
+{
+   size_t nodes = 0;
+
+   for (size_t i = 0; i < m_thread_pool->GetThreadCount(); ++i)
+      nodes += m_threads[i].nodes_searched;
+
+   return nodes;
+}
+
+unsigned __int64 SearchingEngine::GetElapsedTime() const
+{
+   return ::GetTickCount64() - m_start_tick_count;
+}
+
+// mate scores count plies from the root, but the transposition table keeps
+// them from the stored position, since a position can be reached at any ply
+
+static inline int ScoreToTable(int score, size_t ply)
+{
+   if (score >= SCORE_MATE_BOUND)
+      return score + (int)ply;
+   if (score <= -SCORE_MATE_BOUND)
+      return score - (int)ply;
+   return score;
+}
+
+static inline int ScoreFromTable(int score, size_t ply)
+{
+   if (score >= SCORE_MATE_BOUND)
+      return score - (int)ply;
+   if (score <= -SCORE_MATE_BOUND)
+      return score + (int)ply;
+   return score;
+}
+
+int SearchingEngine::GetBestMove(SearchThread *thread,
+   const Move *suggestion, size_t ply, size_t current_depth, int alpha,
+   int beta, Move **best, bool allow_null_move) const
+{
+   // negamax: the score is for the side to move, so a child's score is
+   // negated, and its window is the negated window swapped
+
+   const Position &position = *thread->position;
+   const size_t nodes_searched = CountNode(thread);
+
+   if (thread->index == 0
+      && nodes_searched % NODES_BETWEEN_LIMIT_CHECKS == 0)
+      CheckLimits(thread);
+
+   if (m_stop)
+      return 0; // abandoned, so nothing is stored
 
    // if best != null, *best must not be null
    // if no move, resets *best to nullptr
    SCRITTY_ASSERT(best == nullptr || *best != nullptr);
 
-   // if this is beyond max depth, just evaluate the position
+   // if this is beyond max depth, only captures and promotions are searched
    if (current_depth == 0)
-      return EvaluatePosition(position);
+      return Quiesce(thread, ply, 0, alpha, beta);
 
    // for now consider all positions that MAY be claimed as a draw as terminal
-   // nodes as the underdog would normally claim a draw
-   if (position.MayClaimDraw())
+   // nodes as the underdog would normally claim a draw, and a position where
+   // neither side can mate is drawn whatever follows (but the root still
+   // needs a move to play)
+   if (best == nullptr
+      && (position.MayClaimDraw() || position.IsInsufficientMaterial()))
+      return 0;
+
+   // the principal variation of the last iteration is searched first, as
+   // long as this node is on it
+   const bool on_pv = suggestion != nullptr && suggestion == thread->pv + ply;
+
+   // a deep enough earlier search of this position may settle it, otherwise
+   // its best move is the best guess for this search
+
+   TranspositionEntry entry;
+   if (m_transposition_table->Probe(position.GetHash(), &entry))
    {
-      if (best != nullptr)
-         *best = nullptr;
-      return 0.0;
-   }
+      const int score = ScoreFromTable(entry.score, ply);
 
-   // get all legal moves
-   size_t num_moves = m_position->ListAllLegalMoves(move_buffer);
+      if (best == nullptr && entry.depth >= current_depth
+         && (entry.bound == BOUND_EXACT
+         || (entry.bound == BOUND_LOWER && score >= beta)
+         || (entry.bound == BOUND_UPPER && score <= alpha)))
+         return score;
 
-   // if this is a terminal node, return the value of the outcome
+      if (suggestion == nullptr)
+         suggestion = &entry.best_move;
+   }
 
-   if (num_moves == 0)
+   const int original_alpha = alpha;
+   const bool pv_node = beta - alpha > 1; // any other node has a null window
+   const bool in_check = position.IsCheck(position.IsWhiteToMove());
+   Position& must_roll_back = const_cast<Position&>(position);
+
+   // null move pruning, except where passing is unsound: in check, twice in
+   // a row, near a mate score (a pass cannot prove a mate) and with only
+   // pawns left, where the side to move may be in zugzwang
+
+   if (allow_null_move && !pv_node && !in_check
+      && current_depth >= NULL_MOVE_MIN_DEPTH
+      && beta < SCORE_MATE_BOUND && beta > -SCORE_MATE_BOUND
+      && position.HasPiecesOtherThanPawns(
+      position.IsWhiteToMove() ? WHITE : BLACK)
+      && EvaluatePosition(position) >= beta)
    {
-      if (best != nullptr)
-         *best = nullptr;
+      const size_t reduction = NULL_MOVE_REDUCTION
+         + current_depth/NULL_MOVE_DEPTH_STEP;
+      const size_t null_depth = current_depth > reduction + 1
+         ? current_depth - reduction - 1 : 0;
 
-      Outcome outcome = m_position->GetOutcome();
+      must_roll_back.ApplyNullMove();
 
-      if (outcome == OUTCOME_WIN_WHITE)
-         return DBL_MAX;
-      else if (outcome == OUTCOME_WIN_BLACK)
-         return -DBL_MAX;
-      else
-         return 0.0;
+      const int score = -GetBestMove(thread, nullptr, ply + 1, null_depth,
+         -beta, -beta + 1, nullptr, false);
+
+      must_roll_back.RollBackNullMove();
+
+      if (m_stop)
+         return 0; // abandoned, so nothing is stored
+
+      if (score >= beta)
+         return beta; // the score of a pass is not the score of the node
    }
 
-   // algorithm is most efficient when best moves evaluated first
+   // algorithm is most efficient when best moves evaluated first, so the
+   // moves come in stages from the suggestion on, and a cutoff saves
+   // generating the moves of the later stages
+
+   SCRITTY_ASSERT(ply < MAX_SEARCH_DEPTH);
+   SearchPly &stack = thread->stack[ply];
+   MovePicker picker(position, suggestion, &stack.move_list, stack.killers,
+      thread->history);
 
-   if (suggestion != nullptr)
+   Move move, best_move;
+   size_t move_index = 0; // counts the legal moves
+
+   while (picker.Next(&move))
    {
-      for (size_t i = 1; i < num_moves; ++i)
+      if (thread->index == 0 && best != nullptr
+         && GetElapsedTime() >= CURRENT_MOVE_INFO_DELAY)
+         SendCurrentMoveInfo(move, move_index);
+
+      const Move *pv_suggestion = on_pv && move_index == 0
+         && move == thread->pv[ply] && ply + 1 < thread->pv_length
+         ? thread->pv + ply + 1 : nullptr;
+
+      if (move_index++ == 0)
       {
-         if (move_buffer[i] == *suggestion)
-         {
-            move_buffer[i] = *move_buffer;
-            *move_buffer = *suggestion;
-            break;
-         }
+         best_move = move;
+         if (best != nullptr)
+            **best = move;  // must return something
       }
-   }
 
-   if (best != nullptr)
-      **best = *move_buffer;  // must return something
+      // principal variation search: once a move has been searched, the
+      // rest are expected to fail low, which a null window proves cheaply
+      // a move that fails high on it is searched again with the full window
 
-   // alpha-beta pruning minimax search
+      const bool reducible = picker.GetStage() == STAGE_QUIET_MOVES
+         || picker.GetStage() == STAGE_LOSING_CAPTURES;
 
-   if (maximize)
-   {
-      for (size_t i = 0; i < num_moves; ++i)
+      must_roll_back.ApplyKnownLegalMove(move);
+
+      int score;
+
+      if (move_index == 1)
       {
-         Position& must_roll_back = const_cast<Position&>(position);
-         must_roll_back.ApplyKnownLegalMove(move_buffer[i]);
+         score = -GetBestMove(thread, pv_suggestion, ply + 1,
+            current_depth - 1, -beta, -alpha, nullptr, true);
+      }
+      else
+      {
+         // a late quiet move or a capture that loses material by static
+         // exchange evaluation is unlikely to be best, unless it checks, so
+         // it is searched shallower first
+         size_t reduction = 0;
+         if (reducible && !in_check && current_depth >= LMR_MIN_DEPTH
+            && move_index > LMR_MIN_MOVE_INDEX
+            && !position.IsCheck(position.IsWhiteToMove()))
+            reduction = LMR_REDUCTION;
+
+         score = -GetBestMove(thread, nullptr, ply + 1,
+            current_depth - 1 - reduction, -alpha - 1, -alpha, nullptr, true);
+
+         if (score > alpha && reduction > 0 && !m_stop)
+            score = -GetBestMove(thread, nullptr, ply + 1, current_depth - 1,
+               -alpha - 1, -alpha, nullptr, true);
+
+         if (score > alpha && score < beta && !m_stop)
+            score = -GetBestMove(thread, nullptr, ply + 1, current_depth - 1,
+               -beta, -alpha, nullptr, true);
+      }
 
-         double evaluation = GetBestMove(must_roll_back, nullptr,
-            current_depth - 1, alpha,
-            beta, !maximize, nullptr, move_buffer + MAX_NUMBER_OF_LEGAL_MOVES);
+      must_roll_back.RollBackOneMove();
 
-         must_roll_back.RollBackOneMove();
+      if (m_stop)
+         return 0; // abandoned, so nothing is stored
 
-         if (current_depth == MAX_SEARCH_DEPTH)
-         {
-            std::stringstream ss;
-            ss << "score cp " << (int)(100*evaluation) << " ";
-            ss << "currmovenumber " << (i + 1) << " ";
-            ss << "nodes " << m_nodes_searched << " ";
-            ss << "nps " << (int)(((double)1000.0*m_nodes_searched)
-               / (::GetTickCount64() - m_start_tick_count));
-            UCIHandler::send_info(ss.str());
-         }
+      if (score > alpha)
+      {
+         alpha = score; // reassignment of formal parameter intentional
+         best_move = move;
+         if (best != nullptr)
+            **best = move;
+      }
 
-         if (evaluation > alpha)
+      if (alpha >= beta)
+      {
+         // a quiet move that refutes is likely to refute its siblings too
+         // (captures are ordered well enough by what they capture)
+         if (MovePicker::GetCaptureOrder(position, move) == 0)
          {
-            alpha = evaluation; // reassignment of formal parameter intentional
-            if (best != nullptr)
-               **best = move_buffer[i];
+            Move *killers = stack.killers;
+            if (!(killers[0] == move))
+            {
+               for (size_t i = KILLER_SLOTS - 1; i > 0; --i)
+                  killers[i] = killers[i - 1];
+               killers[0] = move;
+            }
+
+            thread->history->Update(position, move, current_depth);
          }
 
-         if (alpha >= beta)
-            return alpha;
+         break;
       }
+   }
+
+   // if this is a terminal node, return the value of the outcome
 
-      return alpha;
+   if (move_index == 0)
+   {
+      if (best != nullptr)
+         *best = nullptr;
+
+      if (!in_check)
+         return 0; // stalemate
+      return -(SCORE_MATE - (int)ply); // mated, later is better
    }
-   else
+
+   Bound bound = BOUND_EXACT;
+   if (alpha <= original_alpha)
+      bound = BOUND_UPPER;
+   else if (alpha >= beta)
+      bound = BOUND_LOWER;
+
+   m_transposition_table->Store(position.GetHash(), current_depth,
+      ScoreToTable(alpha, ply), bound, best_move);
+
+   return alpha;
+}
+
+int SearchingEngine::Quiesce(SearchThread *thread, size_t ply,
+   size_t quiescence_depth, int alpha, int beta) const
+{
+   const Position &position = *thread->position;
+   const size_t nodes_searched = CountNode(thread);
+
+   if (thread->index == 0
+      && nodes_searched % NODES_BETWEEN_LIMIT_CHECKS == 0)
+      CheckLimits(thread);
+
+   if (m_stop)
+      return 0; // abandoned
+
+   if (position.IsInsufficientMaterial())
+      return 0; // the captures may leave nothing to mate with
+
+   if (quiescence_depth == MAX_QUIESCENCE_DEPTH)
+      return EvaluatePosition(position);
+
+   // the side to move may stand pat on the evaluation instead of capturing,
+   // unless it is in check, in which case every move is searched
+
+   const bool in_check = position.IsCheck(position.IsWhiteToMove());
+
+   if (!in_check)
    {
-      for (size_t i = 0; i < num_moves; ++i)
-      {
-         Position& must_roll_back = const_cast<Position&>(position);
-         must_roll_back.ApplyKnownLegalMove(move_buffer[i]);
+      const int stand_pat = EvaluatePosition(position);
 
-         double evaluation = GetBestMove(must_roll_back, nullptr,
-            current_depth - 1, alpha,
-            beta, !maximize, nullptr, move_buffer + MAX_NUMBER_OF_LEGAL_MOVES);
+      if (stand_pat >= beta)
+         return stand_pat;
+      if (stand_pat > alpha)
+         alpha = stand_pat;
+   }
 
-         must_roll_back.RollBackOneMove();
+   // only captures and promotions, unless every move is needed
 
-         if (current_depth == MAX_SEARCH_DEPTH)
-         {
-            std::stringstream ss;
-            ss << "score cp " << (int)(-100*evaluation) << " ";
-            ss << "currmovenumber " << (i + 1) << " ";
-            ss << "nodes " << m_nodes_searched << " ";
-            ss << "nps " << (int)(((double)1000.0*m_nodes_searched)
-               / (::GetTickCount64() - m_start_tick_count));
-            UCIHandler::send_info(ss.str());
-         }
+   SCRITTY_ASSERT(ply < SEARCH_STACK_SIZE);
+   MovePicker picker(position, nullptr, &thread->stack[ply].move_list,
+      !in_check);
+   Position& must_roll_back = const_cast<Position&>(position);
 
-         if (evaluation < beta)
-         {
-            beta = evaluation; // reassignment of formal parameter intentional
-            if (best != nullptr)
-               **best = move_buffer[i];
-         }
+   Move move;
+   bool found_move = false;
 
-         if (beta <= alpha)
-            return beta;
-      }
+   while (picker.Next(&move))
+   {
+      // a capture that loses material by static exchange evaluation is not
+      // worth searching when standing pat is allowed (they come last)
+      if (!in_check && picker.GetStage() == STAGE_LOSING_CAPTURES)
+         break;
+
+      found_move = true;
+      must_roll_back.ApplyKnownLegalMove(move);
+
+      const int score = -Quiesce(thread, ply + 1, quiescence_depth + 1,
+         -beta, -alpha);
+
+      must_roll_back.RollBackOneMove();
 
-      return beta;
+      if (m_stop)
+         return 0; // abandoned
+
+      if (score > alpha)
+         alpha = score;
+
+      if (alpha >= beta)
+         break;
    }
+
+   if (in_check && !found_move)
+      return -(SCORE_MATE - (int)ply); // checkmate
+
+   return alpha;
 }
 
-double SearchingEngine::EvaluatePosition(const Position &position) const
+int SearchingEngine::EvaluatePosition(const Position &position) const
 {
+   // the parameters are in pawns, from white's point of view
+
    double evaluation = 0.0;
-   unsigned char endpoints[8*8*4 + 1]; // f1, r1, promotion1, f2, ..., MAGIC_NUM
+   const Bitboard occupied = position.GetOccupied();
 
-   for (unsigned char file = 0; file <= 7; ++file)
+   for (int side = WHITE; side <= BLACK; ++side)
    {
-      for (unsigned char rank = 0; rank <= 7; ++rank)
-      {
-         char piece = m_position->GetPieceAt(file, rank);
-
-         switch (piece)
-         {
-         case 'P':
-            // when pieces are valued based on square and game phase,
-            // pawn controlled squares should be captured
-            evaluation += 1.0;
-            break;
-         case 'p':
-            evaluation -= 1.0;
-            break;
-         case 'B':
-            // at present it is busy work to write endpoints to array, but
-            // will come into play when individual squares have different
-            // values
-            evaluation += m_parameters[0].value;
-            evaluation += m_parameters[4].value
-               *m_position->PopulateBishopEndpoints(file, rank, endpoints);
-            break;
-         case 'b':
-            evaluation -= m_parameters[0].value;
-            evaluation -= m_parameters[4].value
-               *m_position->PopulateBishopEndpoints(file, rank, endpoints);
-            break;
-         case 'N':
-            evaluation += m_parameters[1].value;
-            evaluation += m_parameters[4].value
-               *m_position->PopulateKnightEndpoints(file, rank, endpoints);
-            break;
-         case 'n':
-            evaluation -= m_parameters[1].value;
-            evaluation -= m_parameters[4].value
-               *m_position->PopulateKnightEndpoints(file, rank, endpoints);
-            break;
-         case 'R':
-            evaluation += m_parameters[2].value;
-            evaluation += m_parameters[4].value
-               *m_position->PopulateRookEndpoints(file, rank, endpoints);
-            break;
-         case 'r':
-            evaluation -= m_parameters[2].value;
-            evaluation -= m_parameters[4].value
-               *m_position->PopulateRookEndpoints(file, rank, endpoints);
-            break;
-         case 'Q':
-            evaluation += m_parameters[3].value;
-            evaluation += m_parameters[4].value
-               *m_position->PopulateQueenEndpoints(file, rank, endpoints);
-            break;
-         case 'q':
-            evaluation -= m_parameters[3].value;
-            evaluation -= m_parameters[4].value
-               *m_position->PopulateQueenEndpoints(file, rank, endpoints);
-            break;
-         case 'K':
-            // castle not considered
-            evaluation += m_parameters[4].value
-               *m_position->PopulateKingEndpoints(file, rank, endpoints);
-            break;
-         case 'k':
-            evaluation -= m_parameters[4].value
-               *m_position->PopulateKingEndpoints(file, rank, endpoints);
-            break;
-         }
-      }
+      const double sign = side == WHITE ? 1.0 : -1.0;
+      const Bitboard own = position.GetSidePieces((Side)side);
+
+      // when pieces are valued based on square and game phase,
+      // pawn controlled squares should be counted
+      evaluation += sign*CountSquares(
+         position.GetPieces(GetPieceIndex((Side)side, PAWN)));
+
+      // material, plus the squares each piece controls (own pieces excluded
+      // except for the king, castle not considered)
+
+      unsigned int controlled = 0;
+      Bitboard pieces = position.GetPieces(GetPieceIndex((Side)side, BISHOP));
+      evaluation += sign*m_parameters[0].value*CountSquares(pieces);
+      while (pieces != 0)
+         controlled += CountSquares(Bitboards::BishopAttacks(
+            PopLowestSquare(&pieces), occupied) & ~own);
+
+      pieces = position.GetPieces(GetPieceIndex((Side)side, KNIGHT));
+      evaluation += sign*m_parameters[1].value*CountSquares(pieces);
+      while (pieces != 0)
+         controlled += CountSquares(
+            Bitboards::KnightAttacks(PopLowestSquare(&pieces)) & ~own);
+
+      pieces = position.GetPieces(GetPieceIndex((Side)side, ROOK));
+      evaluation += sign*m_parameters[2].value*CountSquares(pieces);
+      while (pieces != 0)
+         controlled += CountSquares(Bitboards::RookAttacks(
+            PopLowestSquare(&pieces), occupied) & ~own);
+
+      pieces = position.GetPieces(GetPieceIndex((Side)side, QUEEN));
+      evaluation += sign*m_parameters[3].value*CountSquares(pieces);
+      while (pieces != 0)
+         controlled += CountSquares(Bitboards::QueenAttacks(
+            PopLowestSquare(&pieces), occupied) & ~own);
+
+      pieces = position.GetPieces(GetPieceIndex((Side)side, KING));
+      while (pieces != 0)
+         controlled += CountSquares(
+            Bitboards::KingAttacks(PopLowestSquare(&pieces)));
+
+      evaluation += sign*m_parameters[4].value*controlled;
    }
 
-   return evaluation;
+   const int score = (int)(100*evaluation);
+   return position.IsWhiteToMove() ? score : -score;
 }
 
 /*virtual*/ int SearchingEngine::Compare(GeneticEngine *first,
@@ -5,23 +5,116 @@
 
 #include "Engine.h"
 #include "GeneticTournament.h"
+#include "MovePicker.h"
+#include "TranspositionTable.h"
+#include "ThreadPool.h"
 #include <Windows.h>
+#include <atomic>
 
-#define FIRST_PASS_SEARCH_DEPTH 4
-#define MAX_SEARCH_DEPTH 7
+#define DEFAULT_SEARCH_DEPTH 7 // when the GUI gives no limits
+#define MAX_SEARCH_DEPTH 64
+#define HELPER_EXTRA_DEPTH 1 // odd numbered helper threads search deeper
+#define MAX_QUIESCENCE_DEPTH 32 // plies of captures beyond the search depth
+
+// null move pruning: if passing the turn still fails high on a shallower
+// search, a move surely would, so the node is cut off
+#define NULL_MOVE_MIN_DEPTH 3
+#define NULL_MOVE_REDUCTION 2 // plus one for every NULL_MOVE_DEPTH_STEP
+#define NULL_MOVE_DEPTH_STEP 6
+
+// late move reductions: quiet moves ordered late are searched shallower, and
+// again at full depth only if they beat alpha
+#define LMR_MIN_DEPTH 3
+#define LMR_MIN_MOVE_INDEX 3 // moves searched at full depth first
+#define LMR_REDUCTION 1
+
+// scores are centipawns for the side to move, except that being mated scores
+// -SCORE_MATE plus the plies from the root to the mate (so a quicker mate
+// scores better for the side mating)
+#define SCORE_INFINITE 32000
+#define SCORE_MATE 31000
+#define SCORE_MATE_BOUND (SCORE_MATE - MAX_SEARCH_DEPTH - MAX_QUIESCENCE_DEPTH)
+
+// in sudden death, plan as if this many moves remain
+#define MOVES_TO_GO_GUESS 30
+#define HARD_TIME_LIMIT_FACTOR 3 // how far a search may run over its plan
+#define TIME_SAFETY_MARGIN 50 // milliseconds kept on the clock for overhead
+#define NODES_BETWEEN_LIMIT_CHECKS 1024
+#define CURRENT_MOVE_INFO_DELAY 1000 // milliseconds, to avoid too much traffic
+
+// the plies a search can reach, counting quiescence
+#define SEARCH_STACK_SIZE (MAX_SEARCH_DEPTH + MAX_QUIESCENCE_DEPTH)
 
 namespace scritty
 {
+   // what the search keeps for one ply from the root
+   struct SearchPly
+   {
+      ScoredMoveList move_list;
+
+      // quiet moves that caused cutoffs, for ordering quiet moves
+      Move killers[KILLER_SLOTS]; // latest first
+   };
+
+   // what one search thread searches with
+   // every thread needs its own position, since the search makes its moves on
+   // the position
+   // the memory a thread needs is allocated by its first search and then
+   // kept for the next, so a short search does not pay for allocating it
+   struct SearchThread
+   {
+      size_t index; // thread 0 is the main thread, which reports the result
+      size_t extra_depth;
+      Position *position;
+      UndoRecord *chain; // for the position
+      SearchPly *stack; // SEARCH_STACK_SIZE of them, by ply
+      MoveHistory *history;
+      std::atomic<size_t> nodes_searched; // read by the main thread
+
+      size_t root_depth; // of the current iteration
+      size_t completed_depth; // of the last completed iteration
+
+      // the principal variation of the last completed iteration, which the
+      // next iteration searches first
+      Move pv[MAX_SEARCH_DEPTH];
+      size_t pv_length;
+   };
+
    class SearchingEngine : public GeneticEngine
    {
    public:
       SearchingEngine();
-      ~SearchingEngine() { delete[] m_parameters; }
+      ~SearchingEngine()
+      {
+         delete[] m_parameters;
+         delete m_transposition_table;
+         delete m_thread_pool;
+
+         for (size_t i = 0; i < MAX_THREADS; ++i)
+         {
+            delete[] m_threads[i].chain;
+            delete[] m_threads[i].stack;
+            delete m_threads[i].history;
+         }
+      }
 
       SearchingEngine *Clone() const;
 
       virtual Outcome GetBestMove(std::string *best) const;
 
+      virtual void SetHashSize(size_t megabytes);
+      virtual void SetThreadCount(size_t thread_count);
+      virtual void SetSearchLimits(const SearchLimits &limits);
+      virtual void StopSearch();
+      virtual void PonderHit();
+      virtual void GetPonderMove(std::string *ponder) const;
+
+      ThreadPool *GetThreadPool() const { return m_thread_pool; }
+
+      // what the last search reached
+      size_t GetCompletedDepth() const { return m_threads[0].completed_depth; }
+      size_t GetNodesSearched() const; // by all threads
+
       virtual int Compare(GeneticEngine *first, GeneticEngine *second) const;
 
       void PrintTableStats() { m_position_table->PrintStats(); }
@@ -29,13 +122,58 @@ namespace scritty
    private:
       SearchingEngine(const SearchingEngine &); // copy disallowed
 
-      double GetBestMove(const Position &position, const Move *suggestion,
-         size_t current_depth, double alpha, double beta, bool maximize,
-         Move **best, Move *move_buffer) const;
-      double EvaluatePosition(const Position &position) const; // centipawns
+      // all threads search the same root and share what they find through
+      // the transposition table (lazy SMP)
+      static void SearchTask(void *context, size_t thread_index);
+      void Search(size_t thread_index) const;
+
+      // ply counts from the root, current_depth is what is left to search
+      // (the two need not add up to the root depth, since moves are reduced)
+      int GetBestMove(SearchThread *thread, const Move *suggestion,
+         size_t ply, size_t current_depth, int alpha, int beta, Move **best,
+         bool allow_null_move) const;
+
+      // searches captures and promotions until the position is quiet, so no
+      // position is evaluated in the middle of an exchange
+      int Quiesce(SearchThread *thread, size_t ply, size_t quiescence_depth,
+         int alpha, int beta) const;
+
+      int EvaluatePosition(const Position &position) const; // centipawns
+
+      void PlanSearch() const; // sets the limits of the search to begin
+      void CheckLimits(const SearchThread *thread) const; // stops if reached
+      void ExtractPrincipalVariation(
+         SearchThread *thread, const Move &best) const;
+      void SendIterationInfo(
+         const SearchThread *thread, int score) const;
+      void SendCurrentMoveInfo(const Move &move, size_t move_index) const;
+
+      unsigned __int64 GetElapsedTime() const; // milliseconds
+
+      TranspositionTable *m_transposition_table;
+      ThreadPool *m_thread_pool;
+
+      SearchLimits m_limits;
+
+      mutable SearchThread m_threads[MAX_THREADS];
+      // shared by the search threads and the thread that calls StopSearch
+      // and PonderHit
+      mutable std::atomic<bool> m_stop; // set when every thread should stop
+      std::atomic<bool> m_stop_requested; // by StopSearch
+      std::atomic<bool> m_pondering; // until PonderHit (no limits apply)
+      mutable std::atomic<ULONGLONG> m_start_tick_count;
+
+      // the plan for the current search (zero for no limit)
+      mutable size_t m_max_depth;
+      mutable unsigned __int64 m_soft_time_limit; // no new iteration after
+      mutable unsigned __int64 m_hard_time_limit; // stop even mid-iteration
 
-      mutable size_t m_nodes_searched;
-      mutable ULONGLONG m_start_tick_count;
+      // the main thread's result
+      mutable Move m_best_move;
+      mutable Move m_ponder_move;
+      mutable bool m_found_move;
+      mutable bool m_found_ponder_move;
+      mutable int m_score;
    };
 }
 
@@ -0,0 +1,115 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#include "ThreadPool.h"
+
+using namespace scritty;
+
+ThreadPool::ThreadPool(size_t thread_count /*= DEFAULT_THREADS*/)
+   : m_thread_count(0), m_running(false), m_task(nullptr),
+   m_context(nullptr), m_exiting(false)
+{
+   CreateThreads(thread_count);
+}
+
+ThreadPool::~ThreadPool()
+{
+   Wait();
+   DestroyThreads();
+}
+
+void ThreadPool::Resize(size_t thread_count)
+{
+   Wait();
+
+   if (thread_count == m_thread_count)
+      return;
+
+   DestroyThreads();
+   CreateThreads(thread_count);
+}
+
+void ThreadPool::Start(ThreadTask task, void *context)
+{
+   SCRITTY_ASSERT(!m_running);
+
+   m_task = task;
+   m_context = context;
+   m_running = true;
+
+   for (size_t i = 0; i < m_thread_count; ++i)
+      ::SetEvent(m_workers[i].start_event);
+}
+
+void ThreadPool::Wait()
+{
+   if (!m_running)
+      return;
+
+   ::WaitForMultipleObjects(
+      (DWORD)m_thread_count, m_done_events, TRUE, INFINITE);
+   m_running = false;
+}
+
+/*static*/ DWORD WINAPI ThreadPool::ThreadMain(LPVOID parameter)
+{
+   Worker *worker = (Worker *)parameter;
+   ThreadPool *pool = worker->pool;
+
+   for (;;)
+   {
+      ::WaitForSingleObject(worker->start_event, INFINITE);
+
+      if (pool->m_exiting)
+         break;
+
+      pool->m_task(pool->m_context, worker->index);
+      ::SetEvent(pool->m_done_events[worker->index]);
+   }
+
+   return 0;
+}
+
+void ThreadPool::CreateThreads(size_t thread_count)
+{
+   SCRITTY_ASSERT(m_thread_count == 0);
+
+   if (thread_count < 1)
+      thread_count = 1;
+   if (thread_count > MAX_THREADS)
+      thread_count = MAX_THREADS;
+
+   m_exiting = false;
+
+   for (size_t i = 0; i < thread_count; ++i)
+   {
+      Worker &worker = m_workers[i];
+      worker.pool = this;
+      worker.index = i;
+      worker.start_event = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+      m_done_events[i] = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+      worker.thread
+         = ::CreateThread(nullptr, 0, ThreadMain, &worker, 0, nullptr);
+   }
+
+   m_thread_count = thread_count;
+}
+
+void ThreadPool::DestroyThreads()
+{
+   // wake every thread to see that it is time to exit
+
+   m_exiting = true;
+
+   for (size_t i = 0; i < m_thread_count; ++i)
+      ::SetEvent(m_workers[i].start_event);
+
+   for (size_t i = 0; i < m_thread_count; ++i)
+   {
+      ::WaitForSingleObject(m_workers[i].thread, INFINITE);
+      ::CloseHandle(m_workers[i].thread);
+      ::CloseHandle(m_workers[i].start_event);
+      ::CloseHandle(m_done_events[i]);
+   }
+
+   m_thread_count = 0;
+}
@@ -0,0 +1,64 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#ifndef SCRITTY_THREAD_POOL_H
+#define SCRITTY_THREAD_POOL_H
+
+#include <Windows.h>
+#include <atomic>
+#include "scritty.h"
+
+#define DEFAULT_THREADS 1
+#define MAX_THREADS MAXIMUM_WAIT_OBJECTS // so Wait can wait on all of them
+
+namespace scritty
+{
+   // a task is run once on every thread of the pool
+   typedef void (*ThreadTask)(void *context, size_t thread_index);
+
+   // threads that are created once and then wait for work, so that starting a
+   // search does not pay for creating threads
+   class ThreadPool
+   {
+   public:
+      ThreadPool(size_t thread_count = DEFAULT_THREADS);
+      ~ThreadPool();
+
+      // waits for any running task first
+      void Resize(size_t thread_count);
+
+      size_t GetThreadCount() const { return m_thread_count; }
+
+      // runs the task on every thread and returns without waiting
+      void Start(ThreadTask task, void *context);
+
+      // waits until every thread has finished the started task
+      void Wait();
+
+   private:
+      ThreadPool(const ThreadPool &); // copy disallowed
+
+      struct Worker
+      {
+         ThreadPool *pool;
+         size_t index;
+         HANDLE thread;
+         HANDLE start_event;
+      };
+
+      static DWORD WINAPI ThreadMain(LPVOID parameter);
+
+      void CreateThreads(size_t thread_count);
+      void DestroyThreads();
+
+      Worker m_workers[MAX_THREADS];
+      HANDLE m_done_events[MAX_THREADS];
+      size_t m_thread_count;
+      bool m_running; // a task was started and not yet waited for
+
+      ThreadTask m_task;
+      void *m_context;
+      std::atomic<bool> m_exiting;
+   };
+}
+
+#endif // #ifndef SCRITTY_THREAD_POOL_H
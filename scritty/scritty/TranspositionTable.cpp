@@ -0,0 +1,140 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#include "TranspositionTable.h"
+#include <climits>
+
+using namespace scritty;
+
+TranspositionTable::TranspositionTable(
+   size_t megabytes /*= DEFAULT_TRANSPOSITION_TABLE_MEGABYTES*/) : m_buckets(nullptr)
+{
+   Resize(megabytes);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+   SCRITTY_ASSERT(m_buckets != nullptr);
+   delete[] m_buckets;
+   m_buckets = nullptr;
+}
+
+void TranspositionTable::Resize(size_t megabytes)
+{
+   delete[] m_buckets;
+
+   m_bucket_count = megabytes*1024*1024 / sizeof(Bucket);
+   if (m_bucket_count < 1)
+      m_bucket_count = 1;
+
+   m_buckets = new Bucket[(size_t)m_bucket_count];
+
+   Clear();
+}
+
+void TranspositionTable::Clear()
+{
+   memset(m_buckets, 0, (size_t)m_bucket_count*sizeof(Bucket));
+
+   // empty entries (generation 0) look like they are from an old search
+   m_generation = 1;
+}
+
+void TranspositionTable::NewSearch()
+{
+   if (++m_generation == 0)
+      m_generation = 1;
+}
+
+bool TranspositionTable::Probe(HashKey key, TranspositionEntry *entry) const
+{
+   const Bucket *bucket = GetBucket(key);
+
+   for (size_t i = 0; i < ENTRIES_PER_BUCKET; ++i)
+   {
+      // read each word once, since another thread may be writing them
+      const unsigned __int64 data = bucket->entries[i].data;
+
+      if ((bucket->entries[i].check ^ data) == key)
+      {
+         Unpack(key, data, entry);
+         if (entry->bound != BOUND_NONE)
+            return true;
+      }
+   }
+
+   return false;
+}
+
+void TranspositionTable::Store(HashKey key, size_t depth, int score,
+   Bound bound, const Move &best_move)
+{
+   // replace the same position if it is here, otherwise prefer replacing
+   // entries from older searches, then shallower entries
+
+   SCRITTY_ASSERT(score >= SHRT_MIN && score <= SHRT_MAX);
+
+   Bucket *bucket = GetBucket(key);
+   PackedEntry *replace = bucket->entries;
+   int replace_worth = INT_MAX;
+
+   for (size_t i = 0; i < ENTRIES_PER_BUCKET; ++i)
+   {
+      PackedEntry *packed = bucket->entries + i;
+      const unsigned __int64 data = packed->data;
+      const HashKey entry_key = packed->check ^ data;
+
+      if (entry_key == key)
+      {
+         replace = packed;
+         break;
+      }
+
+      TranspositionEntry entry;
+      Unpack(entry_key, data, &entry);
+
+      const int worth = entry.depth
+         + (entry.generation == m_generation ? 256 : 0);
+
+      if (worth < replace_worth)
+      {
+         replace = packed;
+         replace_worth = worth;
+      }
+   }
+
+   TranspositionEntry entry;
+   entry.key = key;
+   entry.score = (short)score;
+   entry.best_move = best_move;
+   entry.depth = (unsigned char)depth;
+   entry.bound = (unsigned char)bound;
+   entry.generation = m_generation;
+
+   const unsigned __int64 data = Pack(entry);
+   replace->check = key ^ data;
+   replace->data = data;
+}
+
+/*static*/ unsigned __int64 TranspositionTable::Pack(
+   const TranspositionEntry &entry)
+{
+   // bits 0 to 15 the best move, 16 to 31 the score, 32 to 39 the depth,
+   // 40 to 47 the bound and 48 to 55 the generation
+
+   return (unsigned __int64)entry.best_move.Pack()
+      | ((unsigned __int64)(unsigned short)entry.score << 16)
+      | ((unsigned __int64)entry.depth << 32)
+      | ((unsigned __int64)entry.bound << 40)
+      | ((unsigned __int64)entry.generation << 48);
+}
+
+/*static*/ void TranspositionTable::Unpack(
+   HashKey key, unsigned __int64 data, TranspositionEntry *entry)
+{
+   entry->key = key;
+   entry->best_move.Unpack((unsigned short)data);
+   entry->score = (short)(unsigned short)(data >> 16);
+   entry->depth = (unsigned char)(data >> 32);
+   entry->bound = (unsigned char)(data >> 40);
+   entry->generation = (unsigned char)(data >> 48);
+}
@@ -0,0 +1,92 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#ifndef SCRITTY_TRANSPOSITION_TABLE_H
+#define SCRITTY_TRANSPOSITION_TABLE_H
+
+#include "Position.h"
+#include "Zobrist.h"
+
+#define DEFAULT_TRANSPOSITION_TABLE_MEGABYTES 12 // with the position table, 16
+#define ENTRIES_PER_BUCKET 4
+
+namespace scritty
+{
+   // how a stored score relates to the true value of the position
+   enum Bound
+   {
+      BOUND_NONE,
+      BOUND_UPPER, // searched score failed low (true value <= score)
+      BOUND_LOWER, // searched score failed high (true value >= score)
+      BOUND_EXACT
+   };
+
+   class TranspositionEntry
+   {
+   public:
+      HashKey key;
+      short score; // centipawns for the side to move
+      Move best_move;
+      unsigned char depth;
+      unsigned char bound;
+      unsigned char generation; // which search stored this
+   };
+
+   // remembers the results of searched positions so that transpositions
+   // (and later iterations of the same search) are not searched again
+   // all search threads share one table without locking, so each entry is
+   // packed into two words and checked on probing (see PackedEntry)
+   class TranspositionTable
+   {
+   public:
+      TranspositionTable(
+         size_t megabytes = DEFAULT_TRANSPOSITION_TABLE_MEGABYTES);
+      ~TranspositionTable();
+
+      // also clears the table
+      void Resize(size_t megabytes);
+
+      void Clear();
+
+      // call once per search so that older entries are replaced first
+      void NewSearch();
+
+      // returns false if not found
+      bool Probe(HashKey key, TranspositionEntry *entry) const;
+
+      void Store(HashKey key, size_t depth, int score, Bound bound,
+         const Move &best_move);
+
+   private:
+      TranspositionTable(const TranspositionTable &); // copy disallowed
+
+      // check is the key xor data, so an entry torn by two threads writing
+      // at once fails the check on probing instead of mixing their results
+      struct PackedEntry
+      {
+         volatile unsigned __int64 check;
+         volatile unsigned __int64 data; // see Pack
+      };
+
+      struct Bucket
+      {
+         PackedEntry entries[ENTRIES_PER_BUCKET];
+      };
+
+      static unsigned __int64 Pack(const TranspositionEntry &entry);
+      static void Unpack(
+         HashKey key, unsigned __int64 data, TranspositionEntry *entry);
+
+      Bucket *GetBucket(HashKey key) const
+      {
+         // scales the high bits of the key to the bucket count, so that any
+         // number of buckets (and so any size) can be used
+         return m_buckets + (size_t)(((key >> 32)*m_bucket_count) >> 32);
+      }
+
+      Bucket *m_buckets;
+      HashKey m_bucket_count;
+      unsigned char m_generation;
+   };
+}
+
+#endif // #ifndef SCRITTY_TRANSPOSITION_TABLE_H
@@ -4,6 +4,8 @@
 #include <iostream>
 #include "scritty.h"
 #include "Logger.h"
+#include "ThreadPool.h"
+#include <algorithm>
 
 using namespace scritty;
 
@@ -192,7 +194,14 @@ bool UCIHandler::handle_uci(const uci_tokens &tokens)
 
       */
 
-      // place options, etc. here
+      std::cout << "option name Hash type spin default "
+         << DEFAULT_HASH_MEGABYTES << " min 1 max " << MAX_HASH_MEGABYTES
+         << std::endl;
+      std::cout << "option name Threads type spin default "
+         << DEFAULT_THREADS << " min 1 max " << MAX_THREADS << std::endl;
+
+      // the GUI decides when to ponder, so the option changes nothing
+      std::cout << "option name Ponder type check default false" << std::endl;
 
       /* REQUIREMENT
 
@@ -241,7 +250,7 @@ bool UCIHandler::handle_isready(const uci_tokens &tokens)
 
       */
 
-      std::cout << "readyok" << std::endl;
+      send("readyok"); // even while searching
 
       return true;
    }
@@ -258,7 +267,11 @@ bool UCIHandler::handle_quit(const uci_tokens &tokens)
 
    */
 
-   return tokens.size() > 0 && tokens[0] == "quit";
+   if (tokens.size() < 1 || tokens[0] != "quit")
+      return false;
+
+   stop_search();
+   return true;
 }
 
 bool UCIHandler::handle_ucinewgame(const uci_tokens &tokens)
@@ -286,12 +299,92 @@ bool UCIHandler::handle_ucinewgame(const uci_tokens &tokens)
    if (tokens.size() < 1 || tokens[0] != "ucinewgame")
       return false;
 
+   stop_search();
+
    std::cout << "info string Scritty will defeat you!" << std::endl;
 
    m_engine->StartNewGame();
    return true;
 }
 
+bool UCIHandler::handle_setoption(const uci_tokens &tokens)
+{
+   /* REQUIREMENT
+
+   * setoption name <id> [value <x>]
+   this is sent to the engine when the user wants to change the internal
+   parameters of the engine. For the "button" type no value is needed.
+   One string will be sent for each parameter and this will only be sent when
+   the engine is waiting.
+   The name and value of the option in <id> should not be case sensitive and
+   can inlude spaces.
+   The substrings "value" and "name" should be avoided in <id> and <x> to allow
+   unambiguous parsing, for example do not use <name> = "draw value".
+   Here are some strings for the example below:
+      "setoption name Nullmove value true\n"
+      "setoption name Selectivity value 3\n"
+      "setoption name Style value Risky\n"
+      "setoption name Clear Hash\n"
+      "setoption name NalimovPath value c:\chess\tb\4;c:\chess\tb\5\n"
+
+   */
+
+   if (tokens.size() < 3 || tokens[0] != "setoption" || tokens[1] != "name")
+      return false;
+
+   stop_search(); // should only be sent while waiting, but to be safe
+
+   // the name and the value may both include spaces
+
+   std::string name, value;
+   uci_tokens::const_iterator it = tokens.begin() + 2;
+
+   for (; it != tokens.end() && *it != "value"; ++it)
+      name += (name.empty() ? "" : " ") + *it;
+
+   if (it != tokens.end())
+      ++it; // skip "value"
+
+   for (; it != tokens.end(); ++it)
+      value += (value.empty() ? "" : " ") + *it;
+
+   std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+   if (name == "hash")
+   {
+      const int megabytes = atoi(value.c_str());
+
+      if (megabytes < 1 || megabytes > MAX_HASH_MEGABYTES)
+      {
+         Logger::GetStream() << "Bad Hash value: " << value << std::endl;
+         return false;
+      }
+
+      m_engine->SetHashSize(megabytes);
+      return true;
+   }
+
+   if (name == "threads")
+   {
+      const int thread_count = atoi(value.c_str());
+
+      if (thread_count < 1 || thread_count > MAX_THREADS)
+      {
+         Logger::GetStream() << "Bad Threads value: " << value << std::endl;
+         return false;
+      }
+
+      m_engine->SetThreadCount(thread_count);
+      return true;
+   }
+
+   if (name == "ponder")
+      return true;
+
+   Logger::GetStream() << "Unknown option: " << name << std::endl;
+   return false;
+}
+
 bool UCIHandler::handle_position(const uci_tokens &tokens)
 {
    /* REQUIREMENT
@@ -315,15 +408,27 @@ bool UCIHandler::handle_position(const uci_tokens &tokens)
    if (tokens.size() < 2 || tokens[0] != "position")
       return false;
 
+   stop_search(); // should only be sent while waiting, but to be safe
+
+   size_t moves_index = 2; // where "moves" should be
+
    if (tokens[1] == "startpos")
    {
       m_engine->StartNewGame();
    }
    else if (tokens[1] == "fen")
    {
-      // see http://en.wikipedia.org/wiki/Forsyth%E2%80%93Edwards_Notation
-      Logger::LogMessage("TODO P3 fen under construction");
-      return false;
+      // the fen string has several fields of its own
+      std::string fen;
+      for (; moves_index < tokens.size() && tokens[moves_index] != "moves";
+         ++moves_index)
+         fen += tokens[moves_index] + " ";
+
+      if (!m_engine->StartNewGameFromFen(fen))
+      {
+         Logger::GetStream() << "Bad fen: " << fen << std::endl;
+         return false;
+      }
    }
    else
    {
@@ -331,9 +436,9 @@ bool UCIHandler::handle_position(const uci_tokens &tokens)
       return false;
    }
 
-   if (tokens.size() > 3)
+   if (tokens.size() > moves_index + 1)
    {
-      if (tokens[2] != "moves")
+      if (tokens[moves_index] != "moves")
       {
          Logger::LogMessage("Bad position command.  Expected moves.");
          return false;
@@ -350,7 +455,8 @@ bool UCIHandler::handle_position(const uci_tokens &tokens)
 
       */
 
-      for (auto it = tokens.begin() + 3; it != tokens.end(); ++it)
+      for (auto it = tokens.begin() + moves_index + 1; it != tokens.end();
+         ++it)
       {
          if (!m_engine->ApplyMove(*it))
          {
@@ -421,52 +527,170 @@ bool UCIHandler::handle_go(const uci_tokens &tokens)
 
    */
 
-   if (tokens.size() < 2 || tokens[0] != "go")
+   if (tokens.size() < 1 || tokens[0] != "go")
       return false;
 
-   std::cout << "info string Scritty is thinking..." << std::endl;
+   stop_search(); // should only be sent while waiting, but to be safe
+
+   // each limit is followed by its value (other tokens are ignored for now)
 
-   if (tokens[1] == "movetime" || tokens[1] == "depth" || tokens[1] == "nodes")
+   SearchLimits limits;
+
+   for (size_t i = 1; i < tokens.size(); ++i)
    {
-      /* REQUIREMENT
+      if (tokens[i] == "infinite")
+      {
+         limits.infinite = true;
+         continue;
+      }
 
-      * bestmove <move1> [ ponder <move2> ]
-      the engine has stopped searching and found the move <move> best in this
-      position.
-      the engine can send the move it likes to ponder on. The engine must not
-      start pondering automatically.
-      this command must always be sent if the engine stops searching, also in
-      pondering mode if there is a
-      "stop" command, so for every "go" command a "bestmove" command is needed!
-      Directly before that the engine should send a final "info" command with
-      the final search information,
-      the the GUI has the complete statistics about the last search.
+      if (tokens[i] == "ponder")
+      {
+         limits.ponder = true;
+         continue;
+      }
 
-      */
+      if (i + 1 == tokens.size())
+         break;
+
+      const unsigned __int64 value = _atoi64(tokens[i + 1].c_str());
+
+      if (tokens[i] == "depth")
+         limits.depth = (size_t)value;
+      else if (tokens[i] == "nodes")
+         limits.nodes = value;
+      else if (tokens[i] == "movetime")
+         limits.move_time = value;
+      else if (tokens[i] == "wtime")
+         limits.white_time = value;
+      else if (tokens[i] == "btime")
+         limits.black_time = value;
+      else if (tokens[i] == "winc")
+         limits.white_increment = value;
+      else if (tokens[i] == "binc")
+         limits.black_increment = value;
+      else if (tokens[i] == "movestogo")
+         limits.moves_to_go = (size_t)value;
+      else
+         continue;
+
+      ++i; // skip the value
+   }
 
-      std::string best;
-      m_engine->GetBestMove(&best);
+   m_engine->SetSearchLimits(limits);
 
-      Logger::GetStream() << "Best move: " << best << std::endl;
+   send("info string Scritty is thinking...");
 
-      if (!m_engine->ApplyMove(best))
-      {
-         Logger::GetStream() << "Failed to apply own move: "
-            << best << std::endl;
-         return false;
-      }
+   m_searching = true;
+   m_search_thread.Start(search_task, this);
+
+   return true;
+}
 
-      std::cout << "bestmove " << best << std::endl;
+bool UCIHandler::handle_stop(const uci_tokens &tokens)
+{
+   /* REQUIREMENT
 
-      return true;
+   * stop
+   stop calculating as soon as possible,
+   don't forget the "bestmove" and possibly the "ponder" token when finishing
+   the search
+
+   * if the engine receives a command which is not supposed to come, for
+   example "stop" when the engine is not calculating, it should also just
+   ignore it.
+
+   */
+
+   if (tokens.size() < 1 || tokens[0] != "stop")
+      return false;
+
+   stop_search();
+   return true;
+}
+
+bool UCIHandler::handle_ponderhit(const uci_tokens &tokens)
+{
+   /* REQUIREMENT
+
+   * ponderhit
+   the user has played the expected move. This will be sent if the engine was
+   told to ponder on the same move the user has played. The engine should
+   continue searching but switch from pondering to normal search.
+
+   */
+
+   if (tokens.size() < 1 || tokens[0] != "ponderhit")
+      return false;
+
+   if (m_searching)
+      m_engine->PonderHit();
+
+   return true;
+}
+
+void UCIHandler::wait_for_search()
+{
+   m_search_thread.Wait();
+   m_searching = false;
+}
+
+void UCIHandler::stop_search()
+{
+   if (!m_searching)
+      return;
+
+   m_engine->StopSearch();
+   wait_for_search();
+}
+
+/*static*/ void UCIHandler::search_task(
+   void *context, size_t /*thread_index*/)
+{
+   UCIHandler *handler = (UCIHandler*)context;
+
+   /* REQUIREMENT
+
+   * bestmove <move1> [ ponder <move2> ]
+   the engine has stopped searching and found the move <move> best in this
+   position.
+   the engine can send the move it likes to ponder on. The engine must not
+   start pondering automatically.
+   this command must always be sent if the engine stops searching, also in
+   pondering mode if there is a
+   "stop" command, so for every "go" command a "bestmove" command is needed!
+   Directly before that the engine should send a final "info" command with
+   the final search information,
+   the the GUI has the complete statistics about the last search.
+
+   */
+
+   std::string best, ponder;
+   handler->m_engine->GetBestMove(&best);
+   handler->m_engine->GetPonderMove(&ponder);
+
+   Logger::GetStream() << "Best move: " << best << std::endl;
+
+   if (best.empty() || !handler->m_engine->ApplyMove(best))
+   {
+      Logger::GetStream() << "Failed to apply own move: "
+         << best << std::endl;
+      send("bestmove 0000"); // a null move, since one must always be sent
+      return;
    }
 
-   return false;
+   send("bestmove " + best + (ponder.empty() ? "" : " ponder " + ponder));
 }
 
 /*static*/ void UCIHandler::send_info(const std::string &info)
 {
    // only outputs info in UCI mode
    if (s_in_uci_mode)
-      std::cout << "info " << info << std::endl;
+      send("info " + info);
+}
+
+/*static*/ void UCIHandler::send(const std::string &command)
+{
+   // one write, so that lines from different threads are not interleaved
+   std::cout << command + "\n" << std::flush;
 }
@@ -6,28 +6,54 @@
 #include <string>
 #include "Engine.h"
 #include "UCIParser.h"
+#include "ThreadPool.h"
 
 namespace scritty
 {
    class UCIHandler
    {
    public:
-      UCIHandler(Engine* engine) : m_engine(engine)
+      UCIHandler(Engine* engine)
+         : m_engine(engine), m_search_thread(1), m_searching(false)
       {
       }
 
+      ~UCIHandler()
+      {
+         stop_search();
+      }
+
       bool handle_uci(const uci_tokens &tokens);
       bool handle_isready(const uci_tokens &tokens);
       bool handle_quit(const uci_tokens &tokens);
       bool handle_ucinewgame(const uci_tokens &tokens);
+      bool handle_setoption(const uci_tokens &tokens);
       bool handle_position(const uci_tokens &tokens);
       bool handle_go(const uci_tokens &tokens);
+      bool handle_stop(const uci_tokens &tokens);
+      bool handle_ponderhit(const uci_tokens &tokens);
+
+      // waits for the search started by go to send its best move
+      void wait_for_search();
+      void stop_search(); // and wait for the best move
 
       static void send_info(const std::string &info);
 
    private:
+      UCIHandler(const UCIHandler &); // copy disallowed
+
+      static void search_task(void *context, size_t thread_index);
+
+      // writes a whole command at once, since the search thread writes too
+      static void send(const std::string &command);
+
       Engine* m_engine;
 
+      // go searches on its own thread so that input is still read (and
+      // answered) while the engine thinks
+      ThreadPool m_search_thread;
+      bool m_searching;
+
       static bool s_in_uci_mode;
    };
 }
@@ -0,0 +1,39 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#include "Zobrist.h"
+
+using namespace scritty;
+
+/*static*/ HashKey Zobrist::s_piece_keys[PIECE_INDEX_COUNT][64];
+/*static*/ HashKey Zobrist::s_castle_keys[16];
+/*static*/ HashKey Zobrist::s_en_passant_keys[8];
+/*static*/ HashKey Zobrist::s_black_to_move_key;
+
+/*static*/ Zobrist Zobrist::s_instance;
+
+static HashKey NextKey(HashKey *state)
+{
+   // xorshift with a fixed seed, so hashes are the same on every run
+   *state ^= *state >> 12;
+   *state ^= *state << 25;
+   *state ^= *state >> 27;
+   return *state * 2685821657736338717ull;
+}
+
+Zobrist::Zobrist()
+{
+   HashKey state = 0x5c0771e5c0771e5ull;
+
+   for (int piece_index = 0; piece_index < PIECE_INDEX_COUNT; ++piece_index)
+      for (int square = 0; square < 64; ++square)
+         s_piece_keys[piece_index][square] = NextKey(&state);
+
+   // one key per combination of rights saves xor'ing up to four keys
+   for (int castle_rights = 0; castle_rights < 16; ++castle_rights)
+      s_castle_keys[castle_rights] = NextKey(&state);
+
+   for (int file = 0; file < 8; ++file)
+      s_en_passant_keys[file] = NextKey(&state);
+
+   s_black_to_move_key = NextKey(&state);
+}
@@ -0,0 +1,52 @@
+// Scritty is Copyright (c) 2013 by Joel Odom, Marietta, GA, All Rights Reserved
+
+#ifndef SCRITTY_ZOBRIST_H
+#define SCRITTY_ZOBRIST_H
+
+#include "scritty.h"
+#include "Bitboard.h"
+
+namespace scritty
+{
+   typedef unsigned __int64 HashKey;
+
+   // random keys that are xor'ed together to hash a position, so that a move
+   // only has to xor in the keys of what it changes
+   class Zobrist
+   {
+   public:
+
+      static HashKey PieceKey(int piece_index, unsigned char square)
+      {
+         return s_piece_keys[piece_index][square];
+      }
+
+      static HashKey CastleKey(unsigned char castle_rights)
+      {
+         return s_castle_keys[castle_rights];
+      }
+
+      static HashKey EnPassantKey(unsigned char file)
+      {
+         return s_en_passant_keys[file];
+      }
+
+      static HashKey BlackToMoveKey()
+      {
+         return s_black_to_move_key;
+      }
+
+   private:
+
+      Zobrist(); // fills the keys once at startup
+
+      static HashKey s_piece_keys[PIECE_INDEX_COUNT][64];
+      static HashKey s_castle_keys[16];
+      static HashKey s_en_passant_keys[8];
+      static HashKey s_black_to_move_key;
+
+      static Zobrist s_instance;
+   };
+}
+
+#endif // #ifndef SCRITTY_ZOBRIST_H
@@ -6,6 +6,7 @@
 #include "UCIParser.h"
 #include "gtest/gtest.h"
 #include "SearchingEngine.h"
+#include "Perft.h"
 #include "scritty.h"
 
 using namespace scritty;
@@ -18,6 +19,20 @@ using namespace scritty;
 
 */
 
+// a perft depth is all digits, so that a typo is not run as depth 0
+static bool parse_perft_depth(const uci_tokens &tokens, size_t index,
+   int *depth)
+{
+   if (tokens.size() <= index || tokens[index].empty()
+      || tokens[index].size() > 2)
+      return false;
+   for (size_t i = 0; i < tokens[index].size(); i++)
+      if (tokens[index][i] < '0' || tokens[index][i] > '9')
+         return false;
+   *depth = atoi(tokens[index].c_str());
+   return true;
+}
+
 int main(int argc, const char *argv[])
 {
    {
@@ -47,8 +62,13 @@ int main(int argc, const char *argv[])
       communicate in text mode, but be aware of this when for example
       running a Linux engine in a Windows GUI.
 
+      * the engine must always be able to process input from stdin, even
+      while thinking.
+
       */
 
+      // (go only starts the search, which runs on the handler's own thread)
+
       std::string line;
       while (std::getline(std::cin, line))
       {
@@ -78,6 +98,31 @@ int main(int argc, const char *argv[])
                std::cout << "Test results: " << rv << std::endl;
             }
          }
+         else if (tokens[0] == "perft")
+         {
+            // perft <depth> | perft divide <depth> | perft suite
+            // (run on as many threads as the Threads option, which a search
+            // would be using, so any search is stopped first)
+            handler.stop_search();
+
+            const bool divide = tokens.size() > 1 && tokens[1] == "divide";
+            int depth;
+            if (tokens.size() > 1 && tokens[1] == "suite")
+            {
+               Perft::RunSuite(engine.GetThreadPool());
+            }
+            else if (parse_perft_depth(tokens, divide ? 2 : 1, &depth))
+            {
+               PerftTable table;
+               Perft::Run(engine.GetPosition(), depth, divide,
+                  engine.GetThreadPool(), &table);
+            }
+            else
+            {
+               std::cout << "usage: perft <depth> | perft divide <depth> | "
+                  "perft suite" << std::endl;
+            }
+         }
          else if (tokens[0] == "learn")
          {
             SearchingEngine engine;
@@ -98,8 +143,11 @@ int main(int argc, const char *argv[])
             (handler.handle_isready(tokens)
             || handler.handle_uci(tokens)
             || handler.handle_ucinewgame(tokens)
+            || handler.handle_setoption(tokens)
             || handler.handle_position(tokens)
             || handler.handle_go(tokens)
+            || handler.handle_stop(tokens)
+            || handler.handle_ponderhit(tokens)
             ))
          {
             Logger::GetStream() << "Failed to process line: "
@@ -116,8 +164,6 @@ int main(int argc, const char *argv[])
 
 /* REQUIREMENTS TO IMPLEMENT:
 
-* the engine must always be able to process input from stdin, even while thinking.
-
 * The engine will always be in forced mode which means it should never start calculating
   or pondering without receiving a "go" command first.
 
@@ -129,9 +175,6 @@ int main(int argc, const char *argv[])
   Examples: "joho debug on\n" should switch the debug mode on given that joho is not defined,
             "debug joho on\n" will be undefined however.
 
-* if the engine receives a command which is not supposed to come, for example "stop" when the engine is
-  not calculating, it should also just ignore it.
-
 GUI to engine:
 --------------
 
@@ -144,20 +187,6 @@ These are all the command the engine gets from the interface.
    This mode should be switched off by default and this command can be sent
    any time, also when the engine is thinking.
 
-* setoption name <id> [value <x>]
-   this is sent to the engine when the user wants to change the internal parameters
-   of the engine. For the "button" type no value is needed.
-   One string will be sent for each parameter and this will only be sent when the engine is waiting.
-   The name and value of the option in <id> should not be case sensitive and can inlude spaces.
-   The substrings "value" and "name" should be avoided in <id> and <x> to allow unambiguous parsing,
-   for example do not use <name> = "draw value".
-   Here are some strings for the example below:
-      "setoption name Nullmove value true\n"
-      "setoption name Selectivity value 3\n"
-      "setoption name Style value Risky\n"
-      "setoption name Clear Hash\n"
-      "setoption name NalimovPath value c:\chess\tb\4;c:\chess\tb\5\n"
-
 * register
    this is the command to try to register an engine or to tell the engine that registration
    will be done later. This command should always be sent if the engine	has sent "registration error"
@@ -173,14 +202,6 @@ These are all the command the engine gets from the interface.
       "register later"
       "register name Stefan MK code 4359874324"
 
-* stop
-   stop calculating as soon as possible,
-   don't forget the "bestmove" and possibly the "ponder" token when finishing the search
-
-* ponderhit
-   the user has played the expected move. This will be sent if the engine was told to ponder on the same move
-   the user has played. The engine should continue searching but switch from pondering to normal search.
-
 Engine to GUI:
 --------------
 
@@ -7,6 +7,10 @@
 #include "Logger.h"
 #include "scritty.h"
 #include "SearchingEngine.h"
+#include "TranspositionTable.h"
+#include "ThreadPool.h"
+#include "Perft.h"
+#include "MovePicker.h"
 
 #define GAMES_FILE "..\\..\\..\\games database\\3965020games.uci"
 #define GAMES_IN_FILE 3965020
@@ -17,33 +21,21 @@ using namespace scritty;
 /*static*/ bool ScrittyTestEnvironment::s_tests_were_run = false;
 /*static*/ _CrtMemState ScrittyTestEnvironment::s_mem_state;
 
-TEST(position_tests, test_powmod)
-{
-   EXPECT_EQ(1, powmod(0));
-   EXPECT_EQ(2, powmod(1));
-   EXPECT_EQ(4, powmod(2));
-   EXPECT_EQ(8, powmod(3));
-   EXPECT_EQ(16, powmod(4));
-   EXPECT_EQ(32, powmod(5));
-   EXPECT_EQ(64, powmod(6));
-   EXPECT_EQ(6057, powmod(1234));
-   EXPECT_EQ(1, powmod(POSITION_HASH_MODULUS - 1));
-   EXPECT_EQ(42748, powmod((1ull << 63) - 1234));
-}
-
 #define CHECK_MOVE_HASH(move) { \
    EXPECT_TRUE(engine.ApplyMove(move)); \
    const Position &position = engine.GetPosition(); \
-   unsigned int hash = position.GetHash(); \
+   HashKey hash = position.GetHash(); \
+   EXPECT_EQ(position.CalculateHash(), hash); \
    if (hashes.find(hash) != hashes.end()) \
    ++collisions; \
    hashes.insert(hash); }
 
 TEST(position_tests, test_hash_uniformity)
 {
-   // tests for reasonable uniformity of hashes
+   // tests for reasonable uniformity of hashes (and that the incremental
+   // hash matches a full recalculation)
 
-   std::set<unsigned long> hashes;
+   std::set<HashKey> hashes;
    size_t collisions = 0;
 
    RandomEngine engine;
@@ -228,6 +220,7 @@ namespace scritty // for FRIEND_TEST
       tokens.clear();
       UCIParser::BreakIntoTokens("go movetime 2000", &tokens);
       EXPECT_TRUE(handler.handle_go(tokens));
+      handler.wait_for_search();
 
       tokens.clear();
       UCIParser::BreakIntoTokens(
@@ -1040,6 +1033,7 @@ TEST(searching_engine_tests, debug_crash)
    tokens.clear();
    UCIParser::BreakIntoTokens("go movetime 10000", &tokens);
    EXPECT_TRUE(handler.handle_go(tokens));
+   handler.wait_for_search();
 }
 
 TEST(searching_engine_tests, debug_crash2)
@@ -1060,6 +1054,7 @@ TEST(searching_engine_tests, debug_crash2)
    tokens.clear();
    UCIParser::BreakIntoTokens("go movetime 10000", &tokens);
    EXPECT_TRUE(handler.handle_go(tokens));
+   handler.wait_for_search();
 }
 
 TEST(genetic_tournament_tests, DISABLED_test_genetic_tournament)
@@ -1146,7 +1141,7 @@ TEST(position_tests, list_all_legal_moves_test)
       EXPECT_TRUE(engine.ApplyMove("f1h3"));
       EXPECT_TRUE(engine.ApplyMove("a5a4"));
       const Position &position = engine.GetPosition();
-      EXPECT_EQ(26, position.ListAllLegalMoves(move_buffer));
+      EXPECT_EQ(27, position.ListAllLegalMoves(move_buffer)); // e1g1 too
    }
 
    delete[] move_buffer;
@@ -1235,6 +1230,37 @@ TEST(engine_tests, threefold_repetition_test)
    }
 }
 
+TEST(engine_tests, fifty_move_rule_test)
+{
+   {
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(
+         "4k3/8/8/8/8/8/8/R3K3 w - - 99 80"));
+      EXPECT_FALSE(engine.GetPosition().MayClaimDraw());
+      EXPECT_TRUE(engine.ApplyMove("a1a2"));
+      EXPECT_TRUE(engine.GetPosition().MayClaimDraw());
+   }
+
+   {
+      // a capture starts the count again
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(
+         "4k3/8/8/8/8/8/r7/R3K3 w - - 99 80"));
+      EXPECT_TRUE(engine.ApplyMove("a1a2"));
+      EXPECT_FALSE(engine.GetPosition().MayClaimDraw());
+   }
+
+   {
+      // a checkmate on the hundredth ply stands
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(
+         "7k/8/6K1/8/8/8/8/R7 w - - 99 80"));
+      EXPECT_TRUE(engine.ApplyMove("a1a8"));
+      EXPECT_FALSE(engine.GetPosition().MayClaimDraw());
+      EXPECT_EQ(OUTCOME_WIN_WHITE, engine.GetPosition().GetOutcome());
+   }
+}
+
 TEST(searching_engine_tests, debug_crash3)
 {
    SearchingEngine engine;
@@ -1252,6 +1278,7 @@ TEST(searching_engine_tests, debug_crash3)
    tokens.clear();
    UCIParser::BreakIntoTokens("go movetime 2000", &tokens);
    EXPECT_TRUE(handler.handle_go(tokens));
+   handler.wait_for_search();
 }
 
 TEST(searching_engine_tests, illegal_move_test_11)
@@ -1314,13 +1341,14 @@ public:
    {
       m_chain_length = &m_changes; // has to be something
       SetToStartPos();
-      m_hash = 31; // should always stay 31
+      m_hash = 31; // high bits should always stay 0 (same table bucket)
    }
 
    void Change()
    {
       SCRITTY_ASSERT(m_changes < 64);
       m_squares[m_changes / 8][m_changes % 8] = 'x';
+      ++m_hash;
       ++m_changes;
    }
 
@@ -1356,7 +1384,7 @@ TEST(position_tests, test_position_table)
 
    TestPosition test_position;
 
-   for (size_t i = 0; i < 2*MAX_CALCULATED_POSITIONS_PER_ELEMENT; ++i)
+   for (size_t i = 0; i < 2*POSITION_TABLE_BUCKET_SIZE; ++i)
    {
       size_t s;
       EXPECT_FALSE(table->Lookup(
@@ -1369,5 +1397,902 @@ TEST(position_tests, test_position_table)
       test_position.Change();
    }
 
+   delete[] possible_moves;
    delete table;
 }
+
+TEST(position_tests, test_pack_move)
+{
+   Move move = { 4, 1, 4, 3, NO_PIECE }, unpacked;
+   unpacked.Unpack(move.Pack());
+   EXPECT_TRUE(unpacked == move);
+
+   Move white_promotion = { 1, 6, 0, 7, 'N' };
+   unpacked.Unpack(white_promotion.Pack());
+   EXPECT_TRUE(unpacked == white_promotion);
+
+   Move black_promotion = { 7, 1, 7, 0, 'q' };
+   unpacked.Unpack(black_promotion.Pack());
+   EXPECT_TRUE(unpacked == black_promotion);
+
+   // codes past the queen's unpack as no promotion
+   const unsigned short bad_codes[] = { 5, 6, 7, 13, 14, 15 };
+   for (size_t i = 0; i < sizeof(bad_codes)/sizeof(bad_codes[0]); ++i)
+   {
+      unpacked.Unpack((unsigned short)(move.Pack() | (bad_codes[i] << 12)));
+      EXPECT_TRUE(unpacked == move);
+   }
+}
+
+static Bitboard WalkSliderAttacks(unsigned char square, Bitboard occupied,
+   const int *file_steps, const int *rank_steps)
+{
+   Bitboard attacks = 0;
+
+   for (int i = 0; i < 4; ++i)
+   {
+      int file = SQUARE_FILE(square) + file_steps[i];
+      int rank = SQUARE_RANK(square) + rank_steps[i];
+
+      while (file >= 0 && file <= 7 && rank >= 0 && rank <= 7)
+      {
+         attacks |= SquareMask(SQUARE(file, rank));
+         if (occupied & SquareMask(SQUARE(file, rank)))
+            break;
+         file += file_steps[i];
+         rank += rank_steps[i];
+      }
+   }
+
+   return attacks;
+}
+
+TEST(bitboard_tests, test_slider_attacks)
+{
+   // the magic lookups must agree with walking the board square by square
+
+   static const int rook_files[4] = { 0, 1, 0, -1 };
+   static const int rook_ranks[4] = { 1, 0, -1, 0 };
+   static const int bishop_files[4] = { 1, -1, 1, -1 };
+   static const int bishop_ranks[4] = { 1, 1, -1, -1 };
+
+   srand(1234);
+
+   for (int i = 0; i < 1000; ++i)
+   {
+      // sparse random occupancy
+      Bitboard occupied = 0;
+      for (int j = 0; j < 12; ++j)
+         occupied |= SquareMask((unsigned char)(rand() % 64));
+
+      for (unsigned char square = 0; square < 64; ++square)
+      {
+         EXPECT_EQ(WalkSliderAttacks(square, occupied, rook_files, rook_ranks),
+            Bitboards::RookAttacks(square, occupied));
+         EXPECT_EQ(
+            WalkSliderAttacks(square, occupied, bishop_files, bishop_ranks),
+            Bitboards::BishopAttacks(square, occupied));
+      }
+   }
+}
+
+TEST(position_tests, roll_back_test)
+{
+   // rolling back captures, en passant, promotion and castle must restore
+   // the start position exactly
+
+   RandomEngine engine;
+   engine.StartNewGame();
+
+   const char *moves[] = { "e2e4", "d7d5", "e4d5", "c7c5", "d5c6", "g8f6",
+      "c6b7", "e7e6", "b7a8q", "f8e7", "g1f3", "e8g8", "f1e2" };
+   const size_t move_count = sizeof(moves) / sizeof(moves[0]);
+
+   for (size_t i = 0; i < move_count; ++i)
+   {
+      EXPECT_TRUE(engine.ApplyMove(moves[i]));
+      EXPECT_EQ(engine.GetPosition().CalculateHash(),
+         engine.GetPosition().GetHash());
+   }
+
+   EXPECT_EQ('Q', engine.GetPieceAt("a8"));
+   EXPECT_EQ('k', engine.GetPieceAt("g8"));
+
+   Position &position = const_cast<Position&>(engine.GetPosition());
+   for (size_t i = 0; i < move_count; ++i)
+      position.RollBackOneMove();
+
+   RandomEngine fresh_engine;
+   fresh_engine.StartNewGame();
+   const Position &start = fresh_engine.GetPosition();
+
+   EXPECT_TRUE(position == start);
+   EXPECT_EQ(start.GetHash(), position.GetHash());
+   for (int i = 0; i < PIECE_INDEX_COUNT; ++i)
+      EXPECT_EQ(start.GetPieces(i), position.GetPieces(i));
+}
+
+TEST(transposition_table_tests, test_store_and_probe)
+{
+   TranspositionTable table(1);
+   TranspositionEntry entry;
+   Move move = { 4, 1, 4, 3, NO_PIECE };
+
+   EXPECT_FALSE(table.Probe(12345, &entry));
+
+   table.Store(12345, 5, 150, BOUND_LOWER, move);
+   EXPECT_TRUE(table.Probe(12345, &entry));
+   EXPECT_EQ(5, entry.depth);
+   EXPECT_EQ(150, entry.score);
+   EXPECT_EQ(BOUND_LOWER, entry.bound);
+   EXPECT_TRUE(entry.best_move == move);
+
+   // the same position is overwritten in place
+   table.Store(12345, 2, -30000, BOUND_EXACT, move);
+   EXPECT_TRUE(table.Probe(12345, &entry));
+   EXPECT_EQ(2, entry.depth);
+   EXPECT_EQ(-30000, entry.score);
+
+   // filling the bucket with deeper entries pushes out the shallowest
+   const HashKey bucket_step = 1; // same bucket, different key
+   for (int i = 1; i <= ENTRIES_PER_BUCKET; ++i)
+      table.Store(12345 + i*bucket_step, 3 + i, 0, BOUND_EXACT, move);
+
+   EXPECT_FALSE(table.Probe(12345, &entry));
+   EXPECT_TRUE(table.Probe(12345 + bucket_step, &entry));
+
+   // entries from an older search go first, even if deeper
+   table.NewSearch();
+   table.Store(12345, 1, 0, BOUND_EXACT, move);
+   EXPECT_TRUE(table.Probe(12345, &entry));
+
+   table.Clear();
+   EXPECT_FALSE(table.Probe(12345 + bucket_step, &entry));
+}
+
+TEST(uci_handler_tests, test_setoption)
+{
+   SearchingEngine engine;
+   UCIHandler handler(&engine);
+   uci_tokens tokens;
+
+   UCIParser::BreakIntoTokens("setoption name Hash value 32", &tokens);
+   EXPECT_TRUE(handler.handle_setoption(tokens));
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("setoption name threads value 4", &tokens);
+   EXPECT_TRUE(handler.handle_setoption(tokens));
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("setoption name Hash value 0", &tokens);
+   EXPECT_FALSE(handler.handle_setoption(tokens));
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("setoption name Hash", &tokens);
+   EXPECT_FALSE(handler.handle_setoption(tokens));
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("setoption name Nullmove value true", &tokens);
+   EXPECT_FALSE(handler.handle_setoption(tokens));
+}
+
+static void CountThread(void *context, size_t thread_index)
+{
+   volatile LONG *counts = (volatile LONG *)context;
+   ::InterlockedIncrement(counts + thread_index);
+}
+
+TEST(thread_pool_tests, test_start_and_wait)
+{
+   volatile LONG counts[4] = { 0, 0, 0, 0 };
+
+   ThreadPool pool(2);
+   EXPECT_EQ(2, pool.GetThreadCount());
+   pool.Start(CountThread, (void *)counts);
+   pool.Wait();
+   EXPECT_EQ(1, counts[0]);
+   EXPECT_EQ(1, counts[1]);
+
+   pool.Resize(4);
+   EXPECT_EQ(4, pool.GetThreadCount());
+   pool.Start(CountThread, (void *)counts);
+   pool.Wait();
+   EXPECT_EQ(2, counts[0]);
+   EXPECT_EQ(2, counts[1]);
+   EXPECT_EQ(1, counts[2]);
+   EXPECT_EQ(1, counts[3]);
+}
+
+TEST(position_tests, test_set_to_fen)
+{
+   RandomEngine engine;
+   RandomEngine start_engine;
+   start_engine.StartNewGame();
+
+   EXPECT_TRUE(engine.StartNewGameFromFen(
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"));
+   EXPECT_TRUE(engine.GetPosition() == start_engine.GetPosition());
+   EXPECT_EQ(start_engine.GetPosition().GetHash(),
+      engine.GetPosition().GetHash());
+
+   // the move counters are optional
+   EXPECT_TRUE(engine.StartNewGameFromFen(
+      "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6"));
+   EXPECT_TRUE(engine.ApplyMove("e1e2"));
+   EXPECT_FALSE(engine.IsWhiteToMove());
+
+   EXPECT_FALSE(engine.StartNewGameFromFen(""));
+   EXPECT_FALSE(engine.StartNewGameFromFen(
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1")); // 7 ranks
+   EXPECT_FALSE(engine.StartNewGameFromFen(
+      "rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"));
+   EXPECT_FALSE(engine.StartNewGameFromFen(
+      "rnbq1bnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQ - 0 1")); // no king
+   EXPECT_FALSE(engine.StartNewGameFromFen(
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1"));
+
+   // a failed fen leaves the position alone
+   EXPECT_EQ('K', engine.GetPieceAt("e2"));
+
+   UCIHandler handler(&engine);
+   uci_tokens tokens;
+   UCIParser::BreakIntoTokens("position fen 4k3/8/8/8/8/8/4P3/4K3 w - - 0 1 "
+      "moves e2e4 e8d7", &tokens);
+   EXPECT_TRUE(handler.handle_position(tokens));
+   EXPECT_EQ('P', engine.GetPieceAt("e4"));
+   EXPECT_EQ('k', engine.GetPieceAt("d7"));
+}
+
+TEST(position_tests, test_castle_rights_need_pieces_at_home)
+{
+   // a FEN may claim castle rights that its pieces do not allow, in which
+   // case there is no castle to generate
+
+   const char *fens[] =
+   {
+      "4k3/8/8/8/8/8/8/3K3R w K - 0 1", // no king on e1
+      "4k3/8/8/8/8/8/8/4K2N w K - 0 1", // no rook on h1
+      "r3k3/8/8/8/8/8/8/4K3 b Q - 0 1" // no rook on a1 (and no right to a8)
+   };
+
+   for (size_t i = 0; i < sizeof(fens) / sizeof(fens[0]); ++i)
+   {
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(fens[i]));
+
+      Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+      const size_t count = engine.GetPosition().GenerateLegalMoves(moves);
+      for (size_t j = 0; j < count; ++j)
+      {
+         std::string move;
+         moves[j].ToString(&move);
+         EXPECT_NE("e1g1", move);
+         EXPECT_NE("d1f1", move);
+         EXPECT_NE("e8c8", move);
+      }
+
+      EXPECT_EQ(engine.GetPosition().CalculateHash(),
+         engine.GetPosition().GetHash());
+   }
+}
+
+TEST(position_tests, test_pins_and_checks)
+{
+   const struct
+   {
+      const char *fen;
+      size_t legal_moves;
+   } positions[] =
+   {
+      // the rook may only move along its pin
+      { "4k3/4r3/8/8/8/8/4R3/4K3 b - - 0 1", 9 },
+      // in double check only the king moves (the rook may not capture)
+      { "4k3/8/r4N2/8/8/8/8/4RK2 b - - 0 1", 3 },
+      // a check is blocked or its checker captured
+      { "4k3/8/8/8/1b6/8/8/1N2K1NR w K - 0 1", 6 },
+      // capturing en passant would leave the king in check along the rank
+      { "8/8/8/K1pP3r/8/8/8/7k w - c6 0 1", 5 }
+   };
+
+   for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i)
+   {
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(positions[i].fen));
+
+      Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+      const size_t count = engine.GetPosition().GenerateLegalMoves(moves);
+      EXPECT_EQ(positions[i].legal_moves, count);
+
+      for (size_t j = 0; j < count; ++j)
+         EXPECT_TRUE(engine.GetPosition().IsMoveLegal(moves[j]));
+   }
+}
+
+TEST(position_tests, test_checkers)
+{
+   // the checkers are kept through moves and roll backs
+
+   RandomEngine engine;
+   ASSERT_TRUE(engine.StartNewGameFromFen(
+      "4k3/8/8/8/8/8/4r3/R3K3 w - - 0 1"));
+   Position &position = const_cast<Position&>(engine.GetPosition());
+
+   EXPECT_EQ(SquareMask(SQUARE(4, 1)), position.GetCheckers());
+   EXPECT_TRUE(position.IsCheck(true));
+   EXPECT_FALSE(position.IsCheck(false));
+
+   EXPECT_TRUE(engine.ApplyMove("e1e2"));
+   EXPECT_EQ(0, position.GetCheckers());
+
+   EXPECT_TRUE(engine.ApplyMove("e8d8"));
+   EXPECT_TRUE(engine.ApplyMove("a1a8"));
+   EXPECT_EQ(SquareMask(SQUARE(0, 7)), position.GetCheckers());
+   EXPECT_TRUE(position.IsCheck(false));
+
+   position.RollBackOneMove();
+   position.RollBackOneMove();
+   position.RollBackOneMove();
+   EXPECT_EQ(SquareMask(SQUARE(4, 1)), position.GetCheckers());
+}
+
+TEST(position_tests, test_null_move)
+{
+   // passing the turn gives up en passant, and taking it back restores the
+   // position, its hash and the right to capture en passant
+
+   RandomEngine engine;
+   ASSERT_TRUE(engine.StartNewGameFromFen(
+      "4k3/8/8/8/3pP3/8/8/4K2R b K e3 0 1"));
+
+   Position &position = const_cast<Position&>(engine.GetPosition());
+   const HashKey hash = position.GetHash();
+
+   EXPECT_FALSE(position.HasPiecesOtherThanPawns(BLACK));
+   EXPECT_TRUE(position.HasPiecesOtherThanPawns(WHITE));
+
+   position.ApplyNullMove();
+   EXPECT_TRUE(position.IsWhiteToMove());
+   EXPECT_EQ(position.CalculateHash(), position.GetHash());
+   EXPECT_NE(hash, position.GetHash());
+
+   position.RollBackNullMove();
+   EXPECT_FALSE(position.IsWhiteToMove());
+   EXPECT_EQ(hash, position.GetHash());
+
+   Move en_passant;
+   en_passant.start_file = 3;
+   en_passant.start_rank = 3;
+   en_passant.end_file = 4;
+   en_passant.end_rank = 2;
+   en_passant.promotion_piece = NO_PIECE;
+   EXPECT_TRUE(position.IsMoveLegal(en_passant));
+}
+
+TEST(position_tests, test_null_move_draw_rules)
+{
+   // a null move is not a move in the game, so the positions before it do not
+   // count as repetitions and it does not complete the fifty-move count
+
+   RandomEngine engine;
+   engine.StartNewGame();
+   Position &position = const_cast<Position&>(engine.GetPosition());
+
+   for (int i = 0; i < 2; i++)
+   {
+      ASSERT_TRUE(engine.ApplyMove("g1f3"));
+      position.ApplyNullMove();
+      ASSERT_TRUE(engine.ApplyMove("f3g1"));
+      position.ApplyNullMove();
+   }
+   EXPECT_FALSE(position.MayClaimDraw());
+
+   // the same moves played out do repeat
+   engine.StartNewGame();
+   for (int i = 0; i < 2; i++)
+   {
+      ASSERT_TRUE(engine.ApplyMove("g1f3"));
+      ASSERT_TRUE(engine.ApplyMove("g8f6"));
+      ASSERT_TRUE(engine.ApplyMove("f3g1"));
+      ASSERT_TRUE(engine.ApplyMove("f6g8"));
+   }
+   EXPECT_TRUE(position.MayClaimDraw());
+
+   ASSERT_TRUE(engine.StartNewGameFromFen(
+      "4k3/8/8/8/8/8/4P3/4K3 b - - 99 80"));
+   EXPECT_FALSE(position.MayClaimDraw());
+   position.ApplyNullMove();
+   EXPECT_FALSE(position.MayClaimDraw());
+   position.RollBackNullMove();
+   ASSERT_TRUE(engine.ApplyMove("e8d7"));
+   EXPECT_TRUE(position.MayClaimDraw());
+}
+
+TEST(position_tests, test_static_exchange)
+{
+   const struct
+   {
+      const char *fen;
+      const char *move;
+      int value;
+   } exchanges[] =
+   {
+      // an undefended pawn
+      { "1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "e1e5", 100 },
+      // a defended pawn taken by a rook
+      { "4k3/8/2p5/3p4/8/8/3R4/4K3 w - - 0 1", "d2d5", -400 },
+      // the queen behind the bishop joins in once the bishop has captured
+      { "1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1", "d3e5",
+         -200 },
+      // the king takes back, unless the bishop uncovered by the pawn
+      // defends it
+      { "8/8/8/3k4/2p5/1P6/8/4K3 w - - 0 1", "b3c4", 0 },
+      { "8/8/8/3k4/2p5/1P6/B7/4K3 w - - 0 1", "b3c4", 100 },
+      // en passant
+      { "4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1", "e5d6", 100 }
+   };
+
+   for (size_t i = 0; i < sizeof(exchanges) / sizeof(exchanges[0]); ++i)
+   {
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(exchanges[i].fen));
+
+      Move move;
+      ASSERT_TRUE(UCIParser::ParseMove(exchanges[i].move, &move));
+      EXPECT_TRUE(engine.GetPosition().IsMoveLegal(move));
+      EXPECT_EQ(exchanges[i].value,
+         engine.GetPosition().EvaluateExchange(move));
+   }
+}
+
+TEST(position_tests, test_insufficient_material)
+{
+   const struct
+   {
+      const char *fen;
+      bool insufficient;
+   } positions[] =
+   {
+      { "8/8/8/4k3/8/8/8/4K3 w - - 0 1", true },
+      { "8/8/8/4k3/8/8/8/2B1K3 w - - 0 1", true },
+      { "8/8/8/4k3/8/8/8/1N2K3 b - - 0 1", true },
+      // bishops on dark squares only, whichever side has them
+      { "8/8/8/2b1k3/8/8/8/2B1K3 w - - 0 1", true },
+      { "8/8/8/1b2k3/8/8/8/2B1K3 w - - 0 1", false },
+      { "8/8/8/4k3/8/8/8/1NN1K3 w - - 0 1", false },
+      { "8/8/8/1n2k3/8/8/8/2B1K3 w - - 0 1", false },
+      { "8/8/8/4k3/8/8/P7/4K3 w - - 0 1", false },
+      { "8/8/8/4k3/8/8/8/R3K3 w - - 0 1", false }
+   };
+
+   for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i)
+   {
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(positions[i].fen));
+      EXPECT_EQ(positions[i].insufficient,
+         engine.GetPosition().IsInsufficientMaterial());
+      EXPECT_EQ(positions[i].insufficient ? OUTCOME_DRAW : OUTCOME_UNDECIDED,
+         engine.GetPosition().GetOutcome());
+   }
+}
+
+TEST(perft_tests, test_standard_positions)
+{
+   // shallow counts from the perft suite positions (perft suite runs deeper)
+
+   const struct
+   {
+      const char *fen;
+      size_t depth;
+      unsigned __int64 nodes;
+   } positions[] =
+   {
+      { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      4, 197281ull },
+      { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      3, 97862ull },
+      { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238ull },
+      { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      3, 9467ull },
+      { "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      3, 62379ull },
+      { "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - "
+      "0 10", 3, 89890ull },
+      // the most legal moves of any position
+      { "R6R/3Q4/1Q4Q1/4Q3/2Q4Q/Q4Q2/pp1Q4/kBNN1KB1 w - - 0 1", 1, 218ull }
+   };
+
+   for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i)
+   {
+      RandomEngine engine;
+      ASSERT_TRUE(engine.StartNewGameFromFen(positions[i].fen));
+      EXPECT_EQ(positions[i].nodes,
+         Perft::Count(engine.GetPosition(), positions[i].depth));
+   }
+}
+
+TEST(perft_tests, test_parallel_count_with_table)
+{
+   RandomEngine engine;
+   ASSERT_TRUE(engine.StartNewGameFromFen(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+
+   ThreadPool pool(4);
+   PerftTable table(1);
+   unsigned __int64 move_nodes[MAX_NUMBER_OF_LEGAL_MOVES];
+
+   // the same position counted twice, the second time mostly from the table
+   for (int i = 0; i < 2; ++i)
+   {
+      EXPECT_EQ(4085603ull, Perft::CountInParallel(
+         engine.GetPosition(), 4, &pool, &table, move_nodes));
+   }
+
+   // the count below a root move agrees with a single threaded count
+   Move moves[MAX_NUMBER_OF_LEGAL_MOVES];
+   engine.GetPosition().GenerateLegalMoves(moves);
+   Position& must_roll_back = const_cast<Position&>(engine.GetPosition());
+   must_roll_back.ApplyKnownLegalMove(moves[0]);
+   EXPECT_EQ(Perft::Count(must_roll_back, 3), move_nodes[0]);
+   must_roll_back.RollBackOneMove();
+}
+
+TEST(searching_engine_tests, test_lazy_smp)
+{
+   SearchingEngine engine;
+   engine.SetThreadCount(4);
+   ASSERT_TRUE(engine.StartNewGameFromFen("8/8/4k3/8/2R5/8/4K3/8 w - - 0 1"));
+
+   const HashKey hash = engine.GetPosition().GetHash();
+
+   std::string best;
+   EXPECT_EQ(OUTCOME_UNDECIDED, engine.GetBestMove(&best));
+
+   // the threads search their own copies of the position
+   EXPECT_EQ(hash, engine.GetPosition().GetHash());
+   EXPECT_TRUE(engine.ApplyMove(best));
+}
+
+TEST(searching_engine_tests, test_many_short_searches)
+{
+   // the threads keep their memory from one search to the next, and what
+   // it holds must not leak into a search of another position
+
+   SearchingEngine engine;
+   engine.SetThreadCount(2);
+
+   SearchLimits limits;
+   limits.nodes = 2000;
+   engine.SetSearchLimits(limits);
+
+   const char *fens[] =
+   {
+      "8/8/4k3/8/2R5/8/4K3/8 w - - 0 1",
+      "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq - 0 1"
+   };
+
+   for (size_t i = 0; i < 30; ++i)
+   {
+      ASSERT_TRUE(engine.StartNewGameFromFen(fens[i % 3]));
+
+      std::string best;
+      EXPECT_EQ(OUTCOME_UNDECIDED, engine.GetBestMove(&best));
+      EXPECT_TRUE(engine.ApplyMove(best));
+   }
+}
+
+TEST(searching_engine_tests, test_search_limits)
+{
+   SearchingEngine engine;
+   UCIHandler handler(&engine);
+   uci_tokens tokens;
+
+   // the search stops in the middle of an iteration when the time is up
+
+   UCIParser::BreakIntoTokens("go movetime 200", &tokens);
+   ULONGLONG start_tick_count = ::GetTickCount64();
+   EXPECT_TRUE(handler.handle_go(tokens));
+   handler.wait_for_search();
+   EXPECT_GE(::GetTickCount64() - start_tick_count, 200);
+   EXPECT_LT(::GetTickCount64() - start_tick_count, 1000);
+
+   // a thirtieth of the clock is planned when there is no time control
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("go wtime 3000 btime 3000", &tokens);
+   start_tick_count = ::GetTickCount64();
+   EXPECT_TRUE(handler.handle_go(tokens));
+   handler.wait_for_search();
+   EXPECT_LT(::GetTickCount64() - start_tick_count, 1000);
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("go depth 2", &tokens);
+   EXPECT_TRUE(handler.handle_go(tokens));
+   handler.wait_for_search();
+   EXPECT_EQ(2, engine.GetCompletedDepth());
+
+   // the nodes are counted between limit checks, so the search may go a
+   // little past the limit, but no further
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("go nodes 5000", &tokens);
+   EXPECT_TRUE(handler.handle_go(tokens));
+   handler.wait_for_search();
+   EXPECT_GE(engine.GetNodesSearched(), 5000);
+   EXPECT_LT(engine.GetNodesSearched(), 5000 + NODES_BETWEEN_LIMIT_CHECKS);
+}
+
+TEST(searching_engine_tests, test_quiescence)
+{
+   SearchingEngine engine;
+   SearchLimits limits;
+   limits.depth = 1;
+   engine.SetSearchLimits(limits);
+   std::string best;
+
+   // the pawn is defended, so taking it loses the queen beyond the horizon
+   EXPECT_TRUE(engine.StartNewGameFromFen(
+      "4k3/8/4p3/3p4/8/8/8/3QK3 w - - 0 1"));
+   engine.GetBestMove(&best);
+   EXPECT_NE(best, "d1d5");
+
+   // and the queen must move out of the pawn's reach
+   EXPECT_TRUE(engine.StartNewGameFromFen(
+      "4k3/8/1p6/2p5/3Q4/8/8/4K3 w - - 0 1"));
+   engine.GetBestMove(&best);
+   EXPECT_EQ(best.substr(0, 2), "d4");
+   EXPECT_NE(best, "d4c5");
+}
+
+TEST(searching_engine_tests, test_mate_distance)
+{
+   SearchingEngine engine;
+   SearchLimits limits;
+   limits.depth = 4;
+   engine.SetSearchLimits(limits);
+   std::string best;
+
+   // slower mates are in reach too, but the quickest scores best
+   EXPECT_TRUE(engine.StartNewGameFromFen(
+      "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"));
+   EXPECT_EQ(OUTCOME_UNDECIDED, engine.GetBestMove(&best));
+   EXPECT_EQ("a1a8", best);
+
+   // the side being mated puts it off for as long as it can
+   EXPECT_TRUE(engine.StartNewGameFromFen(
+      "7k/8/5K2/8/8/8/8/6Q1 b - - 0 1"));
+   EXPECT_EQ(OUTCOME_UNDECIDED, engine.GetBestMove(&best));
+   EXPECT_TRUE(engine.ApplyMove(best));
+}
+
+TEST(searching_engine_tests, test_move_when_draw_may_be_claimed)
+{
+   // the engine does not claim the draw itself, so it must still move
+
+   SearchingEngine engine;
+   SearchLimits limits;
+   limits.depth = 3;
+   engine.SetSearchLimits(limits);
+   std::string best;
+
+   EXPECT_TRUE(engine.StartNewGameFromFen(
+      "4k3/8/8/8/8/8/4P3/4K3 w - - 100 80"));
+   EXPECT_TRUE(engine.GetPosition().MayClaimDraw());
+   EXPECT_EQ(OUTCOME_UNDECIDED, engine.GetBestMove(&best));
+   EXPECT_TRUE(engine.ApplyMove(best));
+}
+
+TEST(uci_handler_tests, test_stop_while_searching)
+{
+   SearchingEngine engine;
+   UCIHandler handler(&engine);
+   uci_tokens tokens;
+
+   UCIParser::BreakIntoTokens("go infinite", &tokens);
+   EXPECT_TRUE(handler.handle_go(tokens));
+
+   // input is handled while the engine thinks
+   tokens.clear();
+   UCIParser::BreakIntoTokens("isready", &tokens);
+   EXPECT_TRUE(handler.handle_isready(tokens));
+
+   ::Sleep(100);
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("stop", &tokens);
+   const ULONGLONG start_tick_count = ::GetTickCount64();
+   EXPECT_TRUE(handler.handle_stop(tokens));
+   EXPECT_LT(::GetTickCount64() - start_tick_count, 500);
+
+   // the engine has played its best move
+   EXPECT_FALSE(engine.IsWhiteToMove());
+
+   // stop is ignored when not thinking
+   EXPECT_TRUE(handler.handle_stop(tokens));
+}
+
+TEST(uci_handler_tests, test_ponder)
+{
+   SearchingEngine engine;
+   UCIHandler handler(&engine);
+   uci_tokens tokens;
+
+   // pondering ignores the time limit until the ponder hit
+
+   UCIParser::BreakIntoTokens("go ponder movetime 100", &tokens);
+   EXPECT_TRUE(handler.handle_go(tokens));
+
+   ::Sleep(300);
+   EXPECT_TRUE(engine.IsWhiteToMove()); // still thinking
+
+   tokens.clear();
+   UCIParser::BreakIntoTokens("ponderhit", &tokens);
+   const ULONGLONG start_tick_count = ::GetTickCount64();
+   EXPECT_TRUE(handler.handle_ponderhit(tokens));
+   handler.wait_for_search();
+   EXPECT_GE(::GetTickCount64() - start_tick_count, 100);
+   EXPECT_FALSE(engine.IsWhiteToMove());
+
+   // the ponder move is a reply to the move just played
+   std::string ponder;
+   engine.GetPonderMove(&ponder);
+   EXPECT_FALSE(ponder.empty());
+   EXPECT_TRUE(engine.ApplyMove(ponder));
+
+   // ponderhit is ignored when not thinking
+   EXPECT_TRUE(handler.handle_ponderhit(tokens));
+}
+
+TEST(move_picker_tests, test_stages)
+{
+   RandomEngine engine;
+   ASSERT_TRUE(engine.StartNewGameFromFen(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+   Position& must_roll_back = const_cast<Position&>(engine.GetPosition());
+
+   Move legal_moves[MAX_NUMBER_OF_LEGAL_MOVES];
+   const size_t legal_move_count
+      = must_roll_back.GenerateLegalMoves(legal_moves);
+
+   Move castle;
+   castle.start_file = 4;
+   castle.start_rank = 0;
+   castle.end_file = 6;
+   castle.end_rank = 0;
+   castle.promotion_piece = NO_PIECE;
+
+   // every legal move comes exactly once, the suggestion first and then the
+   // captures (except those that may lose) before the quiet moves
+
+   ScoredMoveList list;
+   MovePicker picker(must_roll_back, &castle, &list);
+   Move move;
+   size_t count = 0;
+   bool quiet_move_seen = false;
+   size_t winning_capture_count = 0;
+
+   while (picker.Next(&move))
+   {
+      must_roll_back.ApplyKnownLegalMove(move);
+      const bool legal = !must_roll_back.IsCheck(true);
+      must_roll_back.RollBackOneMove();
+      EXPECT_TRUE(legal);
+
+      size_t matches = 0;
+      for (size_t i = 0; i < legal_move_count; ++i)
+         if (legal_moves[i] == move)
+            ++matches;
+      EXPECT_EQ(1, matches);
+
+      if (count++ == 0)
+      {
+         EXPECT_TRUE(move == castle);
+         continue;
+      }
+
+      // a capture that wins material comes before every quiet move
+      const bool capture
+         = MovePicker::GetCaptureOrder(must_roll_back, move) > 0;
+      if (capture && must_roll_back.EvaluateExchange(move) > 0)
+      {
+         EXPECT_FALSE(quiet_move_seen);
+         ++winning_capture_count;
+      }
+      if (!capture)
+         quiet_move_seen = true;
+   }
+
+   EXPECT_EQ(legal_move_count, count);
+   EXPECT_GT(winning_capture_count, 0u);
+
+   // the 8 captures of this position when only captures are wanted
+   MovePicker capture_picker(must_roll_back, &castle, &list, true);
+   count = 0;
+   while (capture_picker.Next(&move))
+   {
+      EXPECT_GT(MovePicker::GetCaptureOrder(must_roll_back, move), 0);
+      ++count;
+   }
+
+   EXPECT_EQ(8, count);
+}
+
+TEST(move_picker_tests, test_killers_and_history)
+{
+   RandomEngine engine;
+   engine.StartNewGame();
+   ASSERT_TRUE(engine.ApplyMove("e2e4"));
+   ASSERT_TRUE(engine.ApplyMove("e7e5"));
+   const Position &position = engine.GetPosition();
+
+   Move legal_moves[MAX_NUMBER_OF_LEGAL_MOVES];
+   const size_t legal_move_count = position.GenerateLegalMoves(legal_moves);
+
+   // the second killer is blocked, so it is skipped, and the counter-move is
+   // the latest reply to e7e5
+   Move killers[KILLER_SLOTS];
+   UCIParser::ParseMove("g1f3", &killers[0]);
+   UCIParser::ParseMove("e4e5", &killers[1]);
+
+   Move d2d4, f1c4;
+   UCIParser::ParseMove("d2d4", &d2d4);
+   UCIParser::ParseMove("f1c4", &f1c4);
+
+   MoveHistory history;
+   history.Update(position, d2d4, 5);
+   history.Update(position, f1c4, 3);
+   EXPECT_GT(history.GetScore(position, d2d4),
+      history.GetScore(position, f1c4));
+
+   ScoredMoveList list;
+   MovePicker picker(position, nullptr, &list, killers, &history);
+   Move move;
+   size_t count = 0;
+
+   Move counter_move;
+   ASSERT_TRUE(history.GetCounterMove(position, &counter_move));
+   EXPECT_TRUE(counter_move == f1c4);
+
+   while (picker.Next(&move))
+   {
+      if (count == 0)
+      {
+         EXPECT_TRUE(move == killers[0]);
+      }
+      else if (count == 1)
+      {
+         EXPECT_TRUE(move == f1c4); // the counter-move, despite its history
+      }
+      else if (count == 2)
+      {
+         EXPECT_TRUE(move == d2d4); // the best history
+      }
+      ++count;
+
+      size_t matches = 0;
+      for (size_t i = 0; i < legal_move_count; ++i)
+         if (legal_moves[i] == move)
+            ++matches;
+      EXPECT_EQ(1, matches);
+   }
+
+   EXPECT_EQ(legal_move_count, count);
+
+   // after another reply there is no counter-move, so the history alone
+   // orders the same moves
+   RandomEngine other_engine;
+   other_engine.StartNewGame();
+   ASSERT_TRUE(other_engine.ApplyMove("e2e4"));
+   ASSERT_TRUE(other_engine.ApplyMove("e7e6"));
+   const Position &other_position = other_engine.GetPosition();
+
+   Move no_killers[KILLER_SLOTS];
+   memset(no_killers, 0, sizeof(no_killers)); // a1a1 is never legal
+
+   MovePicker other_picker(
+      other_position, nullptr, &list, no_killers, &history);
+   ASSERT_TRUE(other_picker.Next(&move));
+   EXPECT_TRUE(move == d2d4);
+   ASSERT_TRUE(other_picker.Next(&move));
+   EXPECT_TRUE(move == f1c4);
+}